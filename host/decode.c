@@ -0,0 +1,328 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Reference decode of imx678 RAW12 payloads and embedded data lines.
+ *
+ * A RAW12 packet carries two pixels in three bytes: the upper eight bits of
+ * the first and second pixel, then their low nibbles, second pixel's in the
+ * high half. The vector paths move a few packets per iteration and leave the
+ * tail, where a full vector load would run past the payload, to the scalar
+ * loop. x86 picks SSSE3 or AVX2 at runtime, NEON is used whenever the
+ * compiler targets it.
+ *
+ * The embedded line is parsed with a scalar loop only: it is one line per
+ * frame and dominated by the tag checks, not by byte moves.
+ */
+#include <errno.h>
+
+#include "decode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMX678_DECODE_X86
+#include <immintrin.h>
+#endif
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+static const char * const unpack_name[IMX678_UNPACK_NUM] = {
+	[IMX678_UNPACK_SCALAR]	= "scalar",
+	[IMX678_UNPACK_SSSE3]	= "ssse3",
+	[IMX678_UNPACK_AVX2]	= "avx2",
+	[IMX678_UNPACK_NEON]	= "neon",
+};
+
+const char *imx678_unpack_name(enum imx678_unpack_impl impl)
+{
+	return impl < IMX678_UNPACK_NUM ? unpack_name[impl] : "?";
+}
+
+int imx678_unpack_supported(enum imx678_unpack_impl impl)
+{
+	switch (impl) {
+	case IMX678_UNPACK_SCALAR:
+		return 1;
+#ifdef IMX678_DECODE_X86
+	case IMX678_UNPACK_SSSE3:
+		return __builtin_cpu_supports("ssse3");
+	case IMX678_UNPACK_AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+#ifdef __ARM_NEON
+	case IMX678_UNPACK_NEON:
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
+
+enum imx678_unpack_impl imx678_unpack_best(void)
+{
+	static const enum imx678_unpack_impl order[] = {
+		IMX678_UNPACK_NEON, IMX678_UNPACK_AVX2, IMX678_UNPACK_SSSE3,
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(order) / sizeof(order[0]); i++)
+		if (imx678_unpack_supported(order[i]))
+			return order[i];
+
+	return IMX678_UNPACK_SCALAR;
+}
+
+static void unpack_scalar(const uint8_t *src, uint16_t *dst, size_t pixels)
+{
+	for (; pixels >= 2; pixels -= 2, src += 3, dst += 2) {
+		dst[0] = (uint16_t)(src[0] << 4) | (src[2] & 0x0f);
+		dst[1] = (uint16_t)(src[1] << 4) | (src[2] >> 4);
+	}
+
+	/* Half packet: upper bits, then the low nibble */
+	if (pixels)
+		dst[0] = (uint16_t)(src[0] << 4) | (src[1] & 0x0f);
+}
+
+#ifdef IMX678_DECODE_X86
+/*
+ * Four packets to eight pixels per 128 bits. Each 16-bit lane gets the
+ * nibble byte low and the pixel's upper byte high, so a shift right by four
+ * leaves odd pixels complete and even pixels short of their low nibble,
+ * which is still in the low bits of the unshifted lane.
+ */
+#define UNPACK_SHUF	2, 0, 2, 1, 5, 3, 5, 4, 8, 6, 8, 7, 11, 9, 11, 10
+#define UNPACK_HI	0x0ff0, 0xffff, 0x0ff0, 0xffff, \
+			0x0ff0, 0xffff, 0x0ff0, 0xffff
+#define UNPACK_LO	0x000f, 0, 0x000f, 0, 0x000f, 0, 0x000f, 0
+
+__attribute__((target("ssse3")))
+static void unpack_ssse3(const uint8_t *src, uint16_t *dst, size_t pixels)
+{
+	const __m128i shuf = _mm_setr_epi8(UNPACK_SHUF);
+	const __m128i hi = _mm_setr_epi16(UNPACK_HI);
+	const __m128i lo = _mm_setr_epi16(UNPACK_LO);
+
+	/* 16 byte loads for 12 byte steps: stop while 24 bytes are left */
+	for (; pixels >= 16; pixels -= 8, src += 12, dst += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+
+		v = _mm_shuffle_epi8(v, shuf);
+		v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 4), hi),
+				 _mm_and_si128(v, lo));
+		_mm_storeu_si128((__m128i *)dst, v);
+	}
+
+	unpack_scalar(src, dst, pixels);
+}
+
+__attribute__((target("avx2")))
+static void unpack_avx2(const uint8_t *src, uint16_t *dst, size_t pixels)
+{
+	const __m256i shuf = _mm256_setr_epi8(UNPACK_SHUF, UNPACK_SHUF);
+	const __m256i hi = _mm256_setr_epi16(UNPACK_HI, UNPACK_HI);
+	const __m256i lo = _mm256_setr_epi16(UNPACK_LO, UNPACK_LO);
+
+	/* Lanes load at +0 and +12, the upper one reads to +28 */
+	for (; pixels >= 24; pixels -= 16, src += 24, dst += 16) {
+		__m256i v = _mm256_castsi128_si256(
+			_mm_loadu_si128((const __m128i *)src));
+
+		v = _mm256_inserti128_si256(v,
+			_mm_loadu_si128((const __m128i *)(src + 12)), 1);
+		v = _mm256_shuffle_epi8(v, shuf);
+		v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 4), hi),
+				    _mm256_and_si256(v, lo));
+		_mm256_storeu_si256((__m256i *)dst, v);
+	}
+
+	unpack_ssse3(src, dst, pixels);
+}
+#endif
+
+#ifdef __ARM_NEON
+/* vld3 splits eight packets into upper bytes and nibble bytes */
+static void unpack_neon(const uint8_t *src, uint16_t *dst, size_t pixels)
+{
+	const uint8x8_t nib = vdup_n_u8(0x0f);
+
+	for (; pixels >= 16; pixels -= 16, src += 24, dst += 16) {
+		uint8x8x3_t v = vld3_u8(src);
+		uint16x8x2_t p;
+
+		p.val[0] = vorrq_u16(vshll_n_u8(v.val[0], 4),
+				     vmovl_u8(vand_u8(v.val[2], nib)));
+		p.val[1] = vorrq_u16(vshll_n_u8(v.val[1], 4),
+				     vmovl_u8(vshr_n_u8(v.val[2], 4)));
+		vst2q_u16(dst, p);
+	}
+
+	unpack_scalar(src, dst, pixels);
+}
+#endif
+
+void imx678_unpack_raw12_impl(enum imx678_unpack_impl impl,
+			      const uint8_t *src, uint16_t *dst, size_t pixels)
+{
+	switch (impl) {
+#ifdef IMX678_DECODE_X86
+	case IMX678_UNPACK_SSSE3:
+		unpack_ssse3(src, dst, pixels);
+		break;
+	case IMX678_UNPACK_AVX2:
+		unpack_avx2(src, dst, pixels);
+		break;
+#endif
+#ifdef __ARM_NEON
+	case IMX678_UNPACK_NEON:
+		unpack_neon(src, dst, pixels);
+		break;
+#endif
+	default:
+		unpack_scalar(src, dst, pixels);
+		break;
+	}
+}
+
+void imx678_unpack_raw12(const uint8_t *src, uint16_t *dst, size_t pixels)
+{
+	imx678_unpack_raw12_impl(imx678_unpack_best(), src, dst, pixels);
+}
+
+void imx678_unpack_raw12_frame(const uint8_t *src, size_t stride,
+			       uint16_t *dst, unsigned int width,
+			       unsigned int height)
+{
+	enum imx678_unpack_impl impl = imx678_unpack_best();
+	unsigned int y;
+
+	for (y = 0; y < height; y++, src += stride, dst += width)
+		imx678_unpack_raw12_impl(impl, src, dst, width);
+}
+
+void imx678_pack_raw12(const uint16_t *src, uint8_t *dst, size_t pixels)
+{
+	for (; pixels >= 2; pixels -= 2, src += 2, dst += 3) {
+		dst[0] = src[0] >> 4;
+		dst[1] = src[1] >> 4;
+		dst[2] = (src[0] & 0x0f) | (src[1] & 0x0f) << 4;
+	}
+
+	if (pixels) {
+		dst[0] = src[0] >> 4;
+		dst[1] = src[0] & 0x0f;
+	}
+}
+
+/* CCS embedded data format: tag byte, then the byte it qualifies */
+#define EMB_START		0x0a
+#define EMB_TAG_ADDR_HI		0xaa
+#define EMB_TAG_ADDR_LO		0xa5
+#define EMB_TAG_DATA		0x5a
+#define EMB_TAG_SKIP		0x55
+#define EMB_TAG_END		0x07
+
+/* Little endian registers, in imx678_embedded_field bit order */
+static const struct {
+	uint16_t reg;
+	uint8_t len;
+} emb_regs[] = {
+	{ 0x3050, 3 },	/* SHR */
+	{ 0x3028, 3 },	/* VMAX */
+	{ 0x302c, 2 },	/* HMAX */
+	{ 0x3070, 2 },	/* GAIN */
+	{ 0x3030, 1 },	/* FDG_SEL0 */
+	{ 0x3020, 1 },	/* WINMODEH */
+	{ 0x3021, 1 },	/* WINMODEV */
+};
+
+#define EMB_NUM_REGS	(sizeof(emb_regs) / sizeof(emb_regs[0]))
+
+/* Next byte of the line, stepping over the packed low bit bytes */
+static int emb_next(const uint8_t *line, size_t len, unsigned int bpp,
+		    size_t *pos)
+{
+	size_t i = *pos;
+
+	if ((bpp == 12 && i % 3 == 2) || (bpp == 10 && i % 5 == 4))
+		i++;
+	if (i >= len)
+		return -1;
+
+	*pos = i + 1;
+
+	return line[i];
+}
+
+int imx678_parse_embedded(const uint8_t *line, size_t len, unsigned int bpp,
+			  struct imx678_embedded *out)
+{
+	uint32_t val[EMB_NUM_REGS] = { 0 };
+	uint8_t seen[EMB_NUM_REGS] = { 0 };
+	int addr = -1;
+	size_t pos = 0;
+	unsigned int i;
+
+	if (bpp != 8 && bpp != 10 && bpp != 12)
+		return -EINVAL;
+	if (emb_next(line, len, bpp, &pos) != EMB_START)
+		return -EINVAL;
+
+	out->regs = 0;
+
+	for (;;) {
+		int tag = emb_next(line, len, bpp, &pos);
+		int data;
+
+		/* Lines are padded with end tags, a cut line ends as well */
+		if (tag < 0 || tag == EMB_TAG_END)
+			break;
+
+		data = emb_next(line, len, bpp, &pos);
+		if (data < 0)
+			return -EINVAL;
+
+		switch (tag) {
+		case EMB_TAG_ADDR_HI:
+			addr = (data << 8) | (addr < 0 ? 0 : (addr & 0xff));
+			break;
+		case EMB_TAG_ADDR_LO:
+			addr = (addr < 0 ? 0 : (addr & 0xff00)) | data;
+			break;
+		case EMB_TAG_SKIP:
+			addr = addr < 0 ? addr : ((addr + 1) & 0xffff);
+			break;
+		case EMB_TAG_DATA:
+			if (addr < 0)
+				return -EINVAL;
+
+			for (i = 0; i < EMB_NUM_REGS; i++) {
+				unsigned int off = addr - emb_regs[i].reg;
+
+				if (off < emb_regs[i].len) {
+					val[i] |= (uint32_t)data << (8 * off);
+					seen[i] |= 1 << off;
+				}
+			}
+			out->regs++;
+			addr = (addr + 1) & 0xffff;
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	out->found = 0;
+	for (i = 0; i < EMB_NUM_REGS; i++)
+		if (seen[i] == (1 << emb_regs[i].len) - 1)
+			out->found |= 1 << i;
+
+	out->shr = val[0] & 0xfffff;
+	out->vmax = val[1] & 0xfffff;
+	out->hmax = val[2];
+	out->gain = val[3];
+	out->fdg = val[4];
+	out->hflip = val[5] & 1;
+	out->vflip = val[6] & 1;
+
+	return 0;
+}
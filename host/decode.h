@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Reference decode of imx678 output for receivers and test tools: unpacking
+ * of CSI-2 RAW12 payloads (the MEDIA_BUS_FMT_S*12_1X12 codes) into 16-bit
+ * samples, and parsing of the register dump in the embedded data line.
+ *
+ * Plain C with no dependency on the kernel shim, so it can be copied into a
+ * userspace pipeline as is.
+ */
+#ifndef __IMX678_HOST_DECODE_H
+#define __IMX678_HOST_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Two RAW12 pixels are sent in three bytes */
+#define IMX678_RAW12_BYTES(pixels)	(((pixels) * 3 + 1) / 2)
+
+enum imx678_unpack_impl {
+	IMX678_UNPACK_SCALAR,
+	IMX678_UNPACK_SSSE3,
+	IMX678_UNPACK_AVX2,
+	IMX678_UNPACK_NEON,
+	IMX678_UNPACK_NUM,
+};
+
+const char *imx678_unpack_name(enum imx678_unpack_impl impl);
+int imx678_unpack_supported(enum imx678_unpack_impl impl);
+/* Fastest implementation the running CPU supports */
+enum imx678_unpack_impl imx678_unpack_best(void);
+
+/*
+ * Unpack @pixels RAW12 samples from @src into @dst, one sample per u16 in
+ * bits 11:0. An odd count reads the half packet at the end of @src.
+ */
+void imx678_unpack_raw12_impl(enum imx678_unpack_impl impl,
+			      const uint8_t *src, uint16_t *dst, size_t pixels);
+void imx678_unpack_raw12(const uint8_t *src, uint16_t *dst, size_t pixels);
+/* A frame of @height lines @stride bytes apart, unpacked back to back */
+void imx678_unpack_raw12_frame(const uint8_t *src, size_t stride,
+			       uint16_t *dst, unsigned int width,
+			       unsigned int height);
+
+/* Inverse of the unpack, for building test payloads */
+void imx678_pack_raw12(const uint16_t *src, uint8_t *dst, size_t pixels);
+
+enum imx678_embedded_field {
+	IMX678_EMB_SHR		= 1 << 0,
+	IMX678_EMB_VMAX		= 1 << 1,
+	IMX678_EMB_HMAX		= 1 << 2,
+	IMX678_EMB_GAIN		= 1 << 3,
+	IMX678_EMB_FDG		= 1 << 4,
+	IMX678_EMB_HFLIP	= 1 << 5,
+	IMX678_EMB_VFLIP	= 1 << 6,
+};
+
+/*
+ * Timing and gain registers of the frame the embedded line came with. A
+ * field is valid when its bit is set in @found, that is when every byte of
+ * the register was in the dump.
+ */
+struct imx678_embedded {
+	uint32_t found;
+	uint32_t shr;
+	uint32_t vmax;
+	uint16_t hmax;
+	uint16_t gain;
+	uint8_t fdg;
+	uint8_t hflip;
+	uint8_t vflip;
+	/* Register bytes in the line, known or not */
+	unsigned int regs;
+};
+
+/*
+ * Parse one SMIA/CCS style tagged embedded data line. @bpp is the packing
+ * the line was sent in, 8, 10 or 12; the packed low bit bytes of RAW10 and
+ * RAW12 are skipped. Returns 0 or -EINVAL for a malformed line.
+ */
+int imx678_parse_embedded(const uint8_t *line, size_t len, unsigned int bpp,
+			  struct imx678_embedded *out);
+
+#endif
@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Checks and throughput of the host decode library: every RAW12 unpack
+ * implementation the CPU supports against the scalar one, then full
+ * resolution frames against the 60 fps frame time, then the embedded data
+ * parser on a line built the way the sensor tags its register dump.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "decode.h"
+
+#define FRAME_WIDTH	3856
+#define FRAME_HEIGHT	2180
+#define FRAME_RATE	60
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fill_random(uint8_t *buf, size_t len, unsigned int *seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = rand_r(seed);
+}
+
+/* Every length up to a few vector steps, at every source alignment */
+static int check_unpack(enum imx678_unpack_impl impl)
+{
+	enum { MAX_PIXELS = 160, SLACK = 32 };
+	uint8_t src[IMX678_RAW12_BYTES(MAX_PIXELS) + 16 + SLACK];
+	uint16_t ref[MAX_PIXELS + 1], out[MAX_PIXELS + 1];
+	unsigned int seed = 678;
+	size_t n, off;
+
+	for (off = 0; off < 16; off++) {
+		for (n = 0; n <= MAX_PIXELS; n++) {
+			fill_random(src, sizeof(src), &seed);
+			imx678_unpack_raw12_impl(IMX678_UNPACK_SCALAR,
+						 src + off, ref, n);
+			ref[n] = out[n] = 0xdead;
+			imx678_unpack_raw12_impl(impl, src + off, out, n);
+			if (memcmp(ref, out, (n + 1) * sizeof(out[0]))) {
+				fprintf(stderr, "%s: mismatch at %zu pixels, offset %zu\n",
+					imx678_unpack_name(impl), n, off);
+				return -EINVAL;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int check_pack(void)
+{
+	enum { PIXELS = 1001 };
+	uint16_t in[PIXELS], out[PIXELS];
+	uint8_t packed[IMX678_RAW12_BYTES(PIXELS)];
+	unsigned int seed = 1;
+	size_t i;
+
+	for (i = 0; i < PIXELS; i++)
+		in[i] = rand_r(&seed) & 0x0fff;
+
+	imx678_pack_raw12(in, packed, PIXELS);
+	imx678_unpack_raw12(packed, out, PIXELS);
+	if (memcmp(in, out, sizeof(in))) {
+		fprintf(stderr, "pack: round trip mismatch\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void bench_frames(enum imx678_unpack_impl impl, unsigned long frames,
+			const uint8_t *src, uint16_t *dst)
+{
+	const size_t stride = IMX678_RAW12_BYTES(FRAME_WIDTH);
+	double ns, budget = 1e9 / FRAME_RATE;
+	unsigned long i;
+	unsigned int y;
+	uint64_t t0;
+
+	t0 = now_ns();
+	for (i = 0; i < frames; i++)
+		for (y = 0; y < FRAME_HEIGHT; y++)
+			imx678_unpack_raw12_impl(impl, src + y * stride,
+						 dst + y * FRAME_WIDTH,
+						 FRAME_WIDTH);
+	ns = (double)(now_ns() - t0) / frames;
+
+	printf("%-8s %4lu frames %10.0f ns/frame %8.1f Mpix/s %5.1f%% of %d fps\n",
+	       imx678_unpack_name(impl), frames, ns,
+	       (double)FRAME_WIDTH * FRAME_HEIGHT * 1e3 / ns,
+	       ns * 100 / budget, FRAME_RATE);
+}
+
+/* Tag and data byte into @line in RAW12 packing, past the nibble bytes */
+static size_t emb_put(uint8_t *line, size_t pos, uint8_t tag, uint8_t data)
+{
+	uint8_t b[2] = { tag, data };
+	unsigned int i;
+
+	for (i = 0; i < 2; i++) {
+		if (pos % 3 == 2)
+			line[pos++] = 0;
+		line[pos++] = b[i];
+	}
+
+	return pos;
+}
+
+static size_t emb_put_regs(uint8_t *line, size_t pos, uint16_t addr,
+			   const uint8_t *val, unsigned int len)
+{
+	unsigned int i;
+
+	pos = emb_put(line, pos, 0xaa, addr >> 8);
+	pos = emb_put(line, pos, 0xa5, addr & 0xff);
+	for (i = 0; i < len; i++)
+		pos = emb_put(line, pos, 0x5a, val[i]);
+
+	return pos;
+}
+
+static int check_embedded(unsigned long iters)
+{
+	static const uint8_t timing[] = {
+		0x00, 0x01,			/* 0x3020 WINMODEH, WINMODEV */
+		0x0c,				/* 0x3022 ADBIT */
+		0x00, 0x00, 0x00, 0x00, 0x00,
+		0xca, 0x08, 0x00, 0x00,		/* 0x3028 VMAX */
+		0x26, 0x02, 0x00, 0x00,		/* 0x302c HMAX */
+		0x01,				/* 0x3030 FDG_SEL0 */
+	};
+	static const uint8_t shr[] = { 0xf4, 0x01, 0x00 };
+	static const uint8_t gain[] = { 0x78, 0x00 };
+	uint8_t line[256];
+	struct imx678_embedded emb;
+	unsigned long i;
+	size_t pos = 0;
+	uint64_t t0;
+	int ret = 0;
+
+	memset(line, 0x07, sizeof(line));
+	line[pos++] = 0x0a;
+	pos = emb_put_regs(line, pos, 0x3020, timing, sizeof(timing));
+	pos = emb_put_regs(line, pos, 0x3050, shr, sizeof(shr));
+	pos = emb_put(line, pos, 0x55, 0x07);
+	emb_put_regs(line, pos, 0x3070, gain, sizeof(gain));
+
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		ret = imx678_parse_embedded(line, sizeof(line), 12, &emb);
+		if (ret)
+			break;
+	}
+
+	if (ret || emb.found != 0x7f || emb.shr != 500 || emb.vmax != 2250 ||
+	    emb.hmax != 550 || emb.gain != 120 || emb.fdg != 1 ||
+	    emb.hflip != 0 || emb.vflip != 1 ||
+	    emb.regs != sizeof(timing) + sizeof(shr) + sizeof(gain)) {
+		fprintf(stderr, "embedded: ret %d found %#x shr %u vmax %u hmax %u gain %u fdg %u flip %u/%u regs %u\n",
+			ret, emb.found, emb.shr, emb.vmax, emb.hmax, emb.gain,
+			emb.fdg, emb.hflip, emb.vflip, emb.regs);
+		return -EINVAL;
+	}
+
+	printf("%-8s %8lu lines %8.0f ns/line\n", "embedded", iters,
+	       (double)(now_ns() - t0) / iters);
+
+	/* Bad start and tag bytes */
+	line[0] = 0;
+	if (imx678_parse_embedded(line, sizeof(line), 12, &emb) != -EINVAL)
+		return -EINVAL;
+	line[0] = 0x0a;
+	line[1] = 0x12;
+	if (imx678_parse_embedded(line, sizeof(line), 12, &emb) != -EINVAL)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n frames] [-s]\n"
+		"  -s  only the scalar path\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long frames = FRAME_RATE;
+	bool scalar_only = false;
+	unsigned int seed = 3856;
+	enum imx678_unpack_impl impl;
+	uint16_t *dst;
+	uint8_t *src;
+	size_t len;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:sh")) != -1) {
+		switch (opt) {
+		case 'n':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			scalar_only = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!frames) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (check_pack())
+		return 1;
+	for (impl = 0; impl < IMX678_UNPACK_NUM; impl++)
+		if (imx678_unpack_supported(impl) && check_unpack(impl))
+			return 1;
+
+	len = IMX678_RAW12_BYTES(FRAME_WIDTH) * FRAME_HEIGHT;
+	src = malloc(len);
+	dst = malloc(sizeof(*dst) * FRAME_WIDTH * FRAME_HEIGHT);
+	if (!src || !dst)
+		return 1;
+	fill_random(src, len, &seed);
+	/* Fault the output in ahead of the first timed pass */
+	memset(dst, 0, sizeof(*dst) * FRAME_WIDTH * FRAME_HEIGHT);
+
+	printf("%dx%d RAW12, best %s\n", FRAME_WIDTH, FRAME_HEIGHT,
+	       imx678_unpack_name(imx678_unpack_best()));
+	for (impl = 0; impl < IMX678_UNPACK_NUM; impl++) {
+		if (!imx678_unpack_supported(impl) ||
+		    (scalar_only && impl != IMX678_UNPACK_SCALAR))
+			continue;
+		bench_frames(impl, frames, src, dst);
+	}
+
+	free(src);
+	free(dst);
+
+	return check_embedded(frames * 1000) ? 1 : 0;
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Fake I2C bus for the imx678 host build: a 16-bit addressed, auto-increment
+ * register file that counts what the driver sends.
+ */
+#ifndef __IMX678_HOST_FAKE_I2C_H
+#define __IMX678_HOST_FAKE_I2C_H
+
+#include "kshim.h"
+
+struct fake_i2c {
+	struct i2c_adapter adap;
+	u8 regs[0x10000];
+
+	/* 0 to succeed, otherwise every transfer fails with this error */
+	int fail_errno;
+
+	unsigned long xfers;		/* i2c_transfer() calls */
+	unsigned long msgs;		/* messages on the bus */
+	unsigned long bytes;		/* payload bytes, address included */
+	unsigned long reg_writes;	/* register bytes written */
+	unsigned long reg_reads;	/* register bytes read */
+};
+
+void fake_i2c_init(struct fake_i2c *bus);
+void fake_i2c_reset_stats(struct fake_i2c *bus);
+u32 fake_i2c_peek(const struct fake_i2c *bus, u16 reg, unsigned int len);
+
+#endif /* __IMX678_HOST_FAKE_I2C_H */
@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Simulated imx678 instance for the host build.
+ */
+#include <unistd.h>
+
+#include "harness.h"
+
+const struct host_sensor_cfg host_default_cfg = {
+	.lanes = 4,
+	.link_freq = 891000000,
+	.xclk = 24000000,
+};
+
+int host_sensor_probe(struct host_sensor *s, const struct host_sensor_cfg *cfg)
+{
+	unsigned int n = 0, f;
+	int ret;
+
+	memset(s, 0, sizeof(*s));
+	fake_i2c_init(&s->bus);
+
+	s->props[n++] = (struct property){ .name = "compatible", .str = "sony,imx678" };
+	if (cfg->link_downshift)
+		s->props[n++] = (struct property){ .name = "sony,link-downshift" };
+	if (cfg->standby_retention)
+		s->props[n++] = (struct property){ .name = "sony,standby-retention" };
+	if (cfg->mid_stream_resize)
+		s->props[n++] = (struct property){ .name = "sony,mid-stream-resize" };
+
+	s->link_freqs[0] = cfg->link_freq;
+	for (f = 0; f < HOST_MAX_ALT_LINK_FREQS && cfg->alt_link_freqs[f]; f++)
+		s->link_freqs[f + 1] = cfg->alt_link_freqs[f];
+	s->ep.num_data_lanes = cfg->lanes;
+	s->ep.link_frequencies = s->link_freqs;
+	s->ep.nr_of_link_frequencies = f + 1;
+	s->ep.clock_noncontinuous = cfg->noncont_clk;
+
+	s->node.name = "imx678@1a";
+	s->node.props = s->props;
+	s->node.num_props = n;
+	s->node.endpoint.ep = &s->ep;
+	s->node.shared_reset = cfg->shared_reset;
+
+	s->client.addr = 0x1a;
+	strcpy(s->client.name, "imx678");
+	s->client.adapter = &s->bus.adap;
+	s->client.dev.name = "10-001a";
+	s->client.dev.of_node = &s->node;
+	s->client.dev.driver = &host_i2c_driver->driver;
+	mutex_init(&s->client.dev.pm_lock);
+
+	host_xclk_rate = cfg->xclk;
+
+	ret = host_i2c_driver->probe(&s->client);
+	if (ret) {
+		host_devres_release_all(&s->client.dev);
+		return ret;
+	}
+
+	s->sd = i2c_get_clientdata(&s->client);
+
+	return 0;
+}
+
+void host_sensor_remove(struct host_sensor *s)
+{
+	host_i2c_driver->remove(&s->client);
+	host_devres_release_all(&s->client.dev);
+	mutex_destroy(&s->client.dev.pm_lock);
+	mutex_destroy(&s->bus.adap.bus_lock);
+	s->sd = NULL;
+}
+
+int host_sensor_set_fmt(struct host_sensor *s, u32 width, u32 height)
+{
+	struct v4l2_subdev_format fmt = {
+		.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+		.pad = 0,
+		.format = {
+			.width = width,
+			.height = height,
+			.code = MEDIA_BUS_FMT_SRGGB12_1X12,
+		},
+	};
+
+	return s->sd->ops->pad->set_fmt(s->sd, NULL, &fmt);
+}
+
+int host_sensor_set_crop(struct host_sensor *s, struct v4l2_rect *r)
+{
+	struct v4l2_subdev_selection sel = {
+		.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+		.pad = 0,
+		.target = V4L2_SEL_TGT_CROP,
+		.r = *r,
+	};
+	int ret;
+
+	ret = s->sd->ops->pad->set_selection(s->sd, NULL, &sel);
+	*r = sel.r;
+
+	return ret;
+}
+
+int host_sensor_s_stream(struct host_sensor *s, int enable)
+{
+	return s->sd->ops->video->s_stream(s->sd, enable);
+}
+
+int host_sensor_wait_idle(struct host_sensor *s, unsigned int timeout_ms)
+{
+	struct device *dev = &s->client.dev;
+	bool active;
+
+	for (;;) {
+		mutex_lock(&dev->pm_lock);
+		active = dev->pm_active || dev->pm_usage;
+		mutex_unlock(&dev->pm_lock);
+
+		if (!active)
+			return 0;
+		if (!timeout_ms--)
+			return -ETIMEDOUT;
+		usleep(1000);
+	}
+}
+
+int host_sensor_suspend(struct host_sensor *s)
+{
+	struct device *dev = &s->client.dev;
+
+	return dev->driver->pm->suspend(dev);
+}
+
+int host_sensor_resume(struct host_sensor *s)
+{
+	struct device *dev = &s->client.dev;
+
+	return dev->driver->pm->resume(dev);
+}
+
+int host_sensor_s_ctrl(struct host_sensor *s, u32 id, s64 val)
+{
+	return host_ioctl_s_ctrl(s->sd->ctrl_handler, id, val);
+}
+
+int host_sensor_g_ctrl(struct host_sensor *s, u32 id, s64 *val)
+{
+	return host_ioctl_g_ctrl(s->sd->ctrl_handler, id, val);
+}
+
+int host_sensor_s_ctrls(struct host_sensor *s, const u32 *ids, const s64 *vals,
+			unsigned int count)
+{
+	return host_ioctl_s_ext_ctrls(s->sd->ctrl_handler, ids, vals, count);
+}
+
+int host_sensor_history(struct host_sensor *s, struct host_history_entry **out)
+{
+	struct host_history_entry *e;
+	char path[64];
+	ssize_t len;
+	int i, n;
+
+	snprintf(path, sizeof(path), "imx678-%s/history.bin", dev_name(&s->client.dev));
+	len = host_debugfs_read(path, (char **)&e);
+	if (len < 0)
+		return len;
+	if (len % sizeof(*e)) {
+		free(e);
+		return -EIO;
+	}
+
+	n = len / sizeof(*e);
+	for (i = 1; i < n; i++) {
+		if (e[i].index <= e[i - 1].index ||
+		    e[i].reserved[0] || e[i].reserved[1] || e[i].reserved[2]) {
+			free(e);
+			return -EIO;
+		}
+	}
+
+	*out = e;
+
+	return n;
+}
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * One simulated imx678 instance for the host build: fake DT node, fake I2C
+ * bus and client, bound to the driver through its i2c_driver.
+ */
+#ifndef __IMX678_HOST_HARNESS_H
+#define __IMX678_HOST_HARNESS_H
+
+#include "fake_i2c.h"
+
+#define HOST_MAX_PROPS	16
+#define HOST_MAX_ALT_LINK_FREQS	2
+
+struct host_sensor_cfg {
+	unsigned int lanes;
+	u64 link_freq;
+	/* Further link-frequencies entries the receiver accepts, 0 terminated */
+	u64 alt_link_freqs[HOST_MAX_ALT_LINK_FREQS];
+	unsigned long xclk;
+	bool noncont_clk;
+	bool link_downshift;
+	bool standby_retention;
+	bool mid_stream_resize;
+	/* XCLR line wired to other instances as well, NULL for one of its own */
+	struct gpio_desc *shared_reset;
+};
+
+struct host_sensor {
+	struct fake_i2c bus;
+	struct i2c_client client;
+	struct device_node node;
+	struct host_endpoint ep;
+	struct property props[HOST_MAX_PROPS];
+	u64 link_freqs[1 + HOST_MAX_ALT_LINK_FREQS];
+	struct v4l2_subdev *sd;
+};
+
+/* Record layout of the driver's debugfs history.bin */
+struct host_history_entry {
+	u64 timestamp_ns;
+	u32 index;
+	u32 frame_seq;
+	u32 shr;
+	u32 vmax;
+	u16 hmax;
+	u16 gain;
+	u8 hcg;
+	u8 flips;
+	u16 roi_left;
+	u16 roi_top;
+	u16 reserved[3];
+};
+
+extern const struct host_sensor_cfg host_default_cfg;
+
+int host_sensor_probe(struct host_sensor *s, const struct host_sensor_cfg *cfg);
+void host_sensor_remove(struct host_sensor *s);
+
+int host_sensor_set_fmt(struct host_sensor *s, u32 width, u32 height);
+/* Active crop, @r is updated to the rectangle the driver applied */
+int host_sensor_set_crop(struct host_sensor *s, struct v4l2_rect *r);
+int host_sensor_s_stream(struct host_sensor *s, int enable);
+/* Wait for runtime suspend, a stop at frame end keeps the sensor up a frame */
+int host_sensor_wait_idle(struct host_sensor *s, unsigned int timeout_ms);
+/* System sleep through the driver's dev_pm_ops */
+int host_sensor_suspend(struct host_sensor *s);
+int host_sensor_resume(struct host_sensor *s);
+int host_sensor_s_ctrl(struct host_sensor *s, u32 id, s64 val);
+int host_sensor_g_ctrl(struct host_sensor *s, u32 id, s64 *val);
+/* Several controls in one VIDIOC_S_EXT_CTRLS call, in the order given */
+int host_sensor_s_ctrls(struct host_sensor *s, const u32 *ids, const s64 *vals,
+			unsigned int count);
+
+/*
+ * Read the history.bin records into a malloc()ed array and check their
+ * indexes increase, returns the number of records or a negative errno.
+ */
+int host_sensor_history(struct host_sensor *s, struct host_history_entry **out);
+
+#endif /* __IMX678_HOST_HARNESS_H */
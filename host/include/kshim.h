@@ -0,0 +1,1111 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Minimal kernel API shim to build imx678.c as a normal process.
+ *
+ * Only what the driver uses is provided. The V4L2 control framework,
+ * runtime PM and I2C follow the kernel semantics the control, timing and
+ * streaming paths depend on (s_ctrl only on change, range clamping, grab,
+ * handler setup order, runtime PM usage counting), everything else is a
+ * stub. The UAPI headers of the host are used as-is.
+ */
+#ifndef __IMX678_HOST_KSHIM_H
+#define __IMX678_HOST_KSHIM_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <linux/media.h>
+#include <linux/media-bus-format.h>
+#include <linux/v4l2-mediabus.h>
+#include <linux/v4l2-subdev.h>
+#include <linux/videodev2.h>
+
+/* ------------------------------------------------------------------------
+ * Types and helpers
+ */
+typedef __u8  u8;
+typedef __u16 u16;
+typedef __u32 u32;
+typedef __u64 u64;
+typedef __s8  s8;
+typedef __s16 s16;
+typedef __s32 s32;
+typedef __s64 s64;
+
+#define __maybe_unused		__attribute__((__unused__))
+#define __always_unused		__attribute__((__unused__))
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+
+#define U8_MAX		((u8)~0U)
+#define U16_MAX		((u16)~0U)
+#define U32_MAX		((u32)~0U)
+#define S32_MAX		((s32)(U32_MAX >> 1))
+#define S64_MAX		((s64)(~0ULL >> 1))
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define BIT(n)			(1UL << (n))
+#define BIT_ULL(n)		(1ULL << (n))
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min(a, b)	({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); _a < _b ? _a : _b; })
+#define max(a, b)	({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); _a > _b ? _a : _b; })
+#define min_t(t, a, b)	({ t _a = (a); t _b = (b); _a < _b ? _a : _b; })
+#define max_t(t, a, b)	({ t _a = (a); t _b = (b); _a > _b ? _a : _b; })
+#define clamp(v, lo, hi)	min(max(v, lo), hi)
+#define clamp_t(t, v, lo, hi)	min_t(t, max_t(t, v, lo), hi)
+
+#define DIV_ROUND_UP(n, d)		(((n) + (d) - 1) / (d))
+#define DIV_ROUND_UP_ULL(n, d)		((u64)DIV_ROUND_UP((u64)(n), (d)))
+#define ALIGN(x, a)			(((x) + ((__typeof__(x))(a) - 1)) & ~((__typeof__(x))(a) - 1))
+#define ALIGN_DOWN(x, a)		ALIGN((x) - ((a) - 1), (a))
+#define DIV_ROUND_CLOSEST(x, d)		(((x) + ((d) / 2)) / (d))
+#define DIV_ROUND_CLOSEST_ULL(x, d)	((u64)DIV_ROUND_CLOSEST((u64)(x), (d)))
+
+#define do_div(n, base) ({					\
+	u32 __base = (base);					\
+	u32 __rem = (u32)((u64)(n) % __base);			\
+	(n) = (u64)(n) / __base;				\
+	__rem;							\
+})
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline s64 div_s64(s64 dividend, s32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+#define MAX_ERRNO	4095
+#define IS_ERR_VALUE(x)	((unsigned long)(void *)(x) >= (unsigned long)-MAX_ERRNO)
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline void *ERR_CAST(const void *ptr)
+{
+	return (void *)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return IS_ERR_VALUE((unsigned long)ptr);
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR(ptr);
+}
+
+/* ------------------------------------------------------------------------
+ * Logging. dev_info() is off unless the harness enables verbose output, the
+ * driver logs on every control write and would otherwise dominate profiles.
+ */
+struct device;
+
+enum host_log_level {
+	HOST_LOG_ERR,
+	HOST_LOG_WARN,
+	HOST_LOG_INFO,
+	HOST_LOG_DBG,
+};
+
+extern int host_log_level;
+
+void host_dev_printk(int level, const struct device *dev, const char *fmt, ...);
+
+#define dev_err(dev, ...)	host_dev_printk(HOST_LOG_ERR, dev, __VA_ARGS__)
+#define dev_warn(dev, ...)	host_dev_printk(HOST_LOG_WARN, dev, __VA_ARGS__)
+#define dev_info(dev, ...)	host_dev_printk(HOST_LOG_INFO, dev, __VA_ARGS__)
+#define dev_dbg(dev, ...)	host_dev_printk(HOST_LOG_DBG, dev, __VA_ARGS__)
+#define dev_err_ratelimited	dev_err
+#define dev_warn_ratelimited	dev_warn
+#define dev_info_ratelimited	dev_info
+#define pr_err(...)		host_dev_printk(HOST_LOG_ERR, NULL, __VA_ARGS__)
+#define pr_warn(...)		host_dev_printk(HOST_LOG_WARN, NULL, __VA_ARGS__)
+#define pr_info(...)		host_dev_printk(HOST_LOG_INFO, NULL, __VA_ARGS__)
+#define WARN_ON(cond)		({ bool __c = !!(cond); if (__c) pr_warn("WARN_ON(%s) at %s:%d\n", #cond, __FILE__, __LINE__); __c; })
+#define WARN_ON_ONCE(cond)	WARN_ON(cond)
+#define BUILD_BUG_ON(cond)	_Static_assert(!(cond), #cond)
+#ifndef static_assert
+#define static_assert(expr, msg)	_Static_assert(expr, msg)
+#endif
+
+/* ------------------------------------------------------------------------
+ * Locking. lockdep_assert_held() checks the owner, which catches the
+ * missing-lock bugs lockdep would report on target.
+ */
+struct mutex {
+	pthread_mutex_t lock;
+	pthread_t owner;
+	bool held;
+};
+
+void mutex_init(struct mutex *m);
+void mutex_destroy(struct mutex *m);
+void mutex_lock(struct mutex *m);
+void mutex_unlock(struct mutex *m);
+bool host_mutex_is_owner(struct mutex *m);
+
+#define lockdep_assert_held(m) do {					\
+	if (!host_mutex_is_owner(m))					\
+		host_lockdep_fail(#m, __FILE__, __LINE__);		\
+} while (0)
+
+void host_lockdep_fail(const char *what, const char *file, int line);
+
+#define DEFINE_MUTEX(name)	struct mutex name = { .lock = PTHREAD_MUTEX_INITIALIZER }
+
+/* ------------------------------------------------------------------------
+ * Lists
+ */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD(name)	struct list_head name = { &(name), &(name) }
+
+static inline void list_add(struct list_head *entry, struct list_head *head)
+{
+	entry->next = head->next;
+	entry->prev = head;
+	head->next->prev = entry;
+	head->next = entry;
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	entry->next = entry->prev = NULL;
+}
+
+#define list_entry(ptr, type, member)	container_of(ptr, type, member)
+
+#define list_for_each_entry(pos, head, member)					\
+	for (pos = list_entry((head)->next, __typeof__(*pos), member);		\
+	     &pos->member != (head);						\
+	     pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+/* ------------------------------------------------------------------------
+ * Time. Sleeps advance a virtual clock instead of blocking, so the 500ms
+ * XCLR wait does not hide the cost of the code paths being profiled. Set
+ * host_real_sleep to really sleep.
+ */
+extern bool host_real_sleep;
+
+void host_delay_us(unsigned long us);
+u64 host_slept_us(void);
+
+#define usleep_range(min, max)	host_delay_us(min)
+#define msleep(ms)		host_delay_us((unsigned long)(ms) * 1000)
+#define udelay(us)		host_delay_us(us)
+
+/* CLOCK_MONOTONIC plus the virtual sleep, so frame counts still advance */
+u64 ktime_get_ns(void);
+
+typedef s64 ktime_t;
+
+static inline ktime_t ns_to_ktime(u64 ns)
+{
+	return ns;
+}
+
+/*
+ * hrtimers fire from one timer thread, work items run on one worker
+ * thread, in the ktime_get_ns() time base.
+ */
+enum hrtimer_restart {
+	HRTIMER_NORESTART,
+	HRTIMER_RESTART,
+};
+
+enum hrtimer_mode {
+	HRTIMER_MODE_ABS,
+	HRTIMER_MODE_REL,
+};
+
+struct hrtimer {
+	struct hrtimer *next;
+	ktime_t expires;
+	bool queued;
+	bool running;
+	enum hrtimer_restart (*function)(struct hrtimer *timer);
+};
+
+void hrtimer_init(struct hrtimer *timer, int clock_id, enum hrtimer_mode mode);
+void hrtimer_start(struct hrtimer *timer, ktime_t tim, enum hrtimer_mode mode);
+int hrtimer_try_to_cancel(struct hrtimer *timer);
+int hrtimer_cancel(struct hrtimer *timer);
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct {
+	struct work_struct *next;
+	work_func_t func;
+	bool pending;
+};
+
+struct workqueue_struct;
+extern struct workqueue_struct *system_wq;
+extern struct workqueue_struct *system_highpri_wq;
+
+#define INIT_WORK(w, f)	do { (w)->next = NULL; (w)->func = (f); (w)->pending = false; } while (0)
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool cancel_work_sync(struct work_struct *work);
+
+/* ------------------------------------------------------------------------
+ * Memory ordering, mapped onto the C11 atomics TSan understands
+ */
+#ifdef __SANITIZE_THREAD__
+/* TSan does not model fences; the payload copy is hidden by data_race() */
+#define smp_wmb()		__atomic_signal_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb()		__atomic_signal_fence(__ATOMIC_SEQ_CST)
+#else
+#define smp_wmb()		__atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb()		__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+#define smp_store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define smp_load_acquire(p)	__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define READ_ONCE(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v)	__atomic_store_n(&(x), v, __ATOMIC_RELAXED)
+#define data_race(expr)		({ __typeof__(expr) __v; host_racy_copy(&__v, &(expr), sizeof(__v)); __v; })
+
+void host_racy_copy(void *dst, const void *src, size_t len);
+
+static inline bool test_and_set_bit(unsigned int nr, unsigned long *addr)
+{
+	return __atomic_fetch_or(addr, BIT(nr), __ATOMIC_SEQ_CST) & BIT(nr);
+}
+
+/* ------------------------------------------------------------------------
+ * Device model and device tree
+ */
+struct property {
+	const char *name;
+	const char *str;	/* string value, or NULL */
+	const u32 *u32s;	/* cell values, or NULL */
+	const u64 *u64s;	/* 64-bit cell values, or NULL */
+	unsigned int n;		/* number of cells */
+};
+
+struct host_endpoint {
+	unsigned int num_data_lanes;
+	const u64 *link_frequencies;
+	unsigned int nr_of_link_frequencies;
+	bool clock_noncontinuous;
+};
+
+struct fwnode_handle {
+	const struct host_endpoint *ep;
+};
+
+struct device_node {
+	const char *name;
+	const struct property *props;
+	unsigned int num_props;
+	struct fwnode_handle endpoint;
+	/* reset-gpios shared with other nodes, NULL for a line of its own */
+	struct gpio_desc *shared_reset;
+};
+
+struct of_device_id {
+	char name[32];
+	char type[32];
+	char compatible[128];
+	const void *data;
+};
+
+struct dev_pm_ops {
+	int (*suspend)(struct device *dev);
+	int (*resume)(struct device *dev);
+	int (*runtime_suspend)(struct device *dev);
+	int (*runtime_resume)(struct device *dev);
+	int (*runtime_idle)(struct device *dev);
+};
+
+#define SET_SYSTEM_SLEEP_PM_OPS(s, r)	.suspend = (s), .resume = (r),
+#define SET_RUNTIME_PM_OPS(s, r, i)	.runtime_suspend = (s), .runtime_resume = (r), .runtime_idle = (i),
+
+struct device_driver {
+	const char *name;
+	const struct of_device_id *of_match_table;
+	const struct dev_pm_ops *pm;
+	int probe_type;
+};
+
+struct host_devres;
+
+struct clk;
+struct regulator;
+
+struct device {
+	const char *name;
+	struct device_node *of_node;
+	const struct device_driver *driver;
+	void *driver_data;
+
+	/* runtime PM */
+	struct mutex pm_lock;
+	int pm_usage;
+	bool pm_enabled;
+	bool pm_active;
+	bool pm_async;
+	unsigned long pm_resumes;
+	unsigned long pm_suspends;
+
+	struct host_devres *devres;
+
+	/* Last clock and regulator handed out, for balance checks */
+	struct clk *clk;
+	struct regulator *regulator;
+};
+
+static inline const char *dev_name(const struct device *dev)
+{
+	return dev->name;
+}
+
+static inline void *dev_get_drvdata(const struct device *dev)
+{
+	return dev->driver_data;
+}
+
+static inline void dev_set_drvdata(struct device *dev, void *data)
+{
+	dev->driver_data = data;
+}
+
+static inline struct fwnode_handle *dev_fwnode(struct device *dev)
+{
+	return dev->of_node ? &dev->of_node->endpoint : NULL;
+}
+
+void *devm_kzalloc(struct device *dev, size_t size, int flags);
+void *devm_kcalloc(struct device *dev, size_t n, size_t size, int flags);
+void devm_kfree(struct device *dev, void *p);
+void host_devres_release_all(struct device *dev);
+
+#define GFP_KERNEL	0
+
+static inline void *kzalloc(size_t size, int flags)
+{
+	return calloc(1, size);
+}
+
+static inline void *kcalloc(size_t n, size_t size, int flags)
+{
+	return calloc(n, size);
+}
+
+static inline void kfree(const void *p)
+{
+	free((void *)p);
+}
+
+static inline void *kvmalloc(size_t size, int flags)
+{
+	return malloc(size);
+}
+
+static inline void *kvmalloc_array(size_t n, size_t size, int flags)
+{
+	return calloc(n, size);
+}
+
+static inline void kvfree(const void *p)
+{
+	free((void *)p);
+}
+
+const struct property *of_find_property(const struct device_node *np, const char *name);
+bool of_property_read_bool(const struct device_node *np, const char *name);
+bool of_property_present(const struct device_node *np, const char *name);
+int of_property_read_u32(const struct device_node *np, const char *name, u32 *val);
+int of_property_read_u32_array(const struct device_node *np, const char *name,
+			       u32 *vals, size_t n);
+int of_property_read_string(const struct device_node *np, const char *name,
+			    const char **out);
+const struct of_device_id *of_match_device(const struct of_device_id *matches,
+					   const struct device *dev);
+
+static inline bool device_property_read_bool(const struct device *dev, const char *name)
+{
+	return of_property_read_bool(dev->of_node, name);
+}
+
+static inline bool device_property_present(const struct device *dev, const char *name)
+{
+	return of_property_present(dev->of_node, name);
+}
+
+static inline int device_property_read_u32_array(const struct device *dev, const char *name,
+						 u32 *vals, size_t n)
+{
+	return of_property_read_u32_array(dev->of_node, name, vals, n);
+}
+
+static inline int device_property_read_u32(const struct device *dev, const char *name, u32 *val)
+{
+	return device_property_read_u32_array(dev, name, val, 1);
+}
+
+struct fwnode_handle *fwnode_graph_get_next_endpoint(struct fwnode_handle *fwnode,
+						     struct fwnode_handle *prev);
+static inline void fwnode_handle_put(struct fwnode_handle *fwnode) { }
+
+/* ------------------------------------------------------------------------
+ * Module
+ */
+#define THIS_MODULE	NULL
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define MODULE_DEVICE_TABLE(type, name)
+#define module_param(name, type, perm)
+#define module_param_named(name, value, type, perm)
+#define MODULE_PARM_DESC(name, desc)
+
+#define PROBE_DEFAULT_STRATEGY		0
+#define PROBE_PREFER_ASYNCHRONOUS	1
+
+/* ------------------------------------------------------------------------
+ * Clock, regulator, GPIO
+ */
+struct clk {
+	unsigned long rate;
+	int enable_count;
+};
+
+/* XCLK rate the fake clock reports, set by the harness before probe */
+extern unsigned long host_xclk_rate;
+
+struct clk *devm_clk_get(struct device *dev, const char *id);
+unsigned long clk_get_rate(struct clk *clk);
+int clk_prepare_enable(struct clk *clk);
+void clk_disable_unprepare(struct clk *clk);
+
+struct regulator {
+	int enable_count;
+};
+
+struct regulator_bulk_data {
+	const char *supply;
+	struct regulator *consumer;
+	int ret;
+};
+
+int devm_regulator_bulk_get(struct device *dev, int num, struct regulator_bulk_data *consumers);
+int regulator_bulk_enable(int num, struct regulator_bulk_data *consumers);
+int regulator_bulk_disable(int num, struct regulator_bulk_data *consumers);
+
+struct gpio_desc {
+	int value;
+	bool requested;
+	bool allocated;	/* a line of its own, freed by gpiod_put() */
+};
+
+enum gpiod_flags {
+	GPIOD_ASIS	= 0,
+	GPIOD_IN	= 1,
+	GPIOD_OUT_LOW	= 3,
+	GPIOD_OUT_HIGH	= 7,
+	GPIOD_FLAGS_BIT_NONEXCLUSIVE	= BIT(4),
+};
+
+struct gpio_desc *gpiod_get_optional(struct device *dev, const char *con_id,
+				     enum gpiod_flags flags);
+void gpiod_put(struct gpio_desc *desc);
+void gpiod_set_value_cansleep(struct gpio_desc *desc, int value);
+
+/* ------------------------------------------------------------------------
+ * I2C
+ */
+#define I2C_M_RD	0x0001
+
+struct i2c_msg {
+	u16 addr;
+	u16 flags;
+	u16 len;
+	u8 *buf;
+};
+
+struct i2c_adapter;
+
+struct i2c_algorithm {
+	int (*master_xfer)(struct i2c_adapter *adap, struct i2c_msg *msgs, int num);
+};
+
+struct i2c_adapter {
+	const struct i2c_algorithm *algo;
+	void *algo_data;
+	struct mutex bus_lock;
+};
+
+struct i2c_client {
+	unsigned short addr;
+	char name[20];
+	struct i2c_adapter *adapter;
+	struct device dev;
+	int irq;
+};
+
+typedef unsigned long kernel_ulong_t;
+
+struct i2c_device_id {
+	char name[20];
+	kernel_ulong_t driver_data;
+};
+
+struct i2c_driver {
+	struct device_driver driver;
+	const struct i2c_device_id *id_table;
+	int (*probe)(struct i2c_client *client);
+	void (*remove)(struct i2c_client *client);
+};
+
+#define to_i2c_client(d)	container_of(d, struct i2c_client, dev)
+
+static inline void *i2c_get_clientdata(const struct i2c_client *client)
+{
+	return dev_get_drvdata(&client->dev);
+}
+
+static inline void i2c_set_clientdata(struct i2c_client *client, void *data)
+{
+	dev_set_drvdata(&client->dev, data);
+}
+
+/* OF match data, else the driver_data of the I2C id matching the client name */
+const void *i2c_get_match_data(const struct i2c_client *client);
+
+int i2c_transfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num);
+int i2c_master_send(const struct i2c_client *client, const char *buf, int count);
+
+/* The harness picks the driver up from here instead of the I2C core */
+extern struct i2c_driver *host_i2c_driver;
+#define module_i2c_driver(__drv) struct i2c_driver *host_i2c_driver = &(__drv)
+
+/* ------------------------------------------------------------------------
+ * Unaligned access
+ */
+static inline u16 get_unaligned_be16(const void *p)
+{
+	const u8 *b = p;
+
+	return (u16)(b[0] << 8 | b[1]);
+}
+
+static inline u32 get_unaligned_be32(const void *p)
+{
+	const u8 *b = p;
+
+	return (u32)b[0] << 24 | (u32)b[1] << 16 | (u32)b[2] << 8 | b[3];
+}
+
+static inline void put_unaligned_be16(u16 val, void *p)
+{
+	u8 *b = p;
+
+	b[0] = val >> 8;
+	b[1] = val;
+}
+
+static inline void put_unaligned_be32(u32 val, void *p)
+{
+	u8 *b = p;
+
+	b[0] = val >> 24;
+	b[1] = val >> 16;
+	b[2] = val >> 8;
+	b[3] = val;
+}
+
+/* ------------------------------------------------------------------------
+ * Runtime PM. Synchronous: a put that drops the usage count to zero
+ * suspends immediately.
+ */
+int pm_runtime_get_sync(struct device *dev);
+int pm_runtime_resume_and_get(struct device *dev);
+int pm_runtime_get_if_in_use(struct device *dev);
+int pm_runtime_put(struct device *dev);
+int pm_runtime_put_sync(struct device *dev);
+void pm_runtime_put_noidle(struct device *dev);
+void pm_runtime_get_noresume(struct device *dev);
+int pm_runtime_set_active(struct device *dev);
+void pm_runtime_set_suspended(struct device *dev);
+void pm_runtime_enable(struct device *dev);
+void pm_runtime_disable(struct device *dev);
+int pm_runtime_idle(struct device *dev);
+bool pm_runtime_status_suspended(struct device *dev);
+int pm_runtime_force_suspend(struct device *dev);
+int pm_runtime_force_resume(struct device *dev);
+void device_enable_async_suspend(struct device *dev);
+
+/* ------------------------------------------------------------------------
+ * Media controller / V4L2 bus types
+ */
+#ifndef MEDIA_BUS_FMT_Y16_1X16
+#define MEDIA_BUS_FMT_Y16_1X16			0x202e
+#endif
+
+#ifndef V4L2_CID_USER_ASPEED_BASE
+#define V4L2_CID_USER_ASPEED_BASE		(V4L2_CID_USER_BASE + 0x11a0)
+#endif
+
+#define MIPI_CSI2_DT_EMBEDDED_8B	0x12
+#define MIPI_CSI2_DT_RAW10		0x2b
+#define MIPI_CSI2_DT_RAW12		0x2c
+#define MIPI_CSI2_DT_RAW16		0x2e
+
+struct media_pad {
+	unsigned long flags;
+};
+
+struct media_entity {
+	u32 function;
+	u16 num_pads;
+	struct media_pad *pads;
+};
+
+int media_entity_pads_init(struct media_entity *entity, u16 num_pads, struct media_pad *pads);
+static inline void media_entity_cleanup(struct media_entity *entity) { }
+
+enum v4l2_mbus_type {
+	V4L2_MBUS_UNKNOWN,
+	V4L2_MBUS_PARALLEL,
+	V4L2_MBUS_BT656,
+	V4L2_MBUS_CSI1,
+	V4L2_MBUS_CCP2,
+	V4L2_MBUS_CSI2_DPHY,
+	V4L2_MBUS_CSI2_CPHY,
+	V4L2_MBUS_DPI,
+	V4L2_MBUS_INVALID,
+};
+
+#define V4L2_MBUS_CSI2_NONCONTINUOUS_CLOCK	BIT(10)
+#define V4L2_MBUS_CSI2_MAX_DATA_LANES		8
+
+struct v4l2_mbus_config_mipi_csi2 {
+	unsigned int flags;
+	unsigned char data_lanes[V4L2_MBUS_CSI2_MAX_DATA_LANES];
+	unsigned char clock_lane;
+	unsigned char num_data_lanes;
+	bool lane_polarities[1 + V4L2_MBUS_CSI2_MAX_DATA_LANES];
+};
+
+struct v4l2_mbus_config {
+	enum v4l2_mbus_type type;
+	union {
+		struct v4l2_mbus_config_mipi_csi2 mipi_csi2;
+	} bus;
+};
+
+enum v4l2_mbus_frame_desc_flags {
+	V4L2_MBUS_FRAME_DESC_FL_LEN_MAX	= BIT(0),
+	V4L2_MBUS_FRAME_DESC_FL_BLOB	= BIT(1),
+};
+
+enum v4l2_mbus_frame_desc_type {
+	V4L2_MBUS_FRAME_DESC_TYPE_UNDEFINED = 0,
+	V4L2_MBUS_FRAME_DESC_TYPE_PARALLEL,
+	V4L2_MBUS_FRAME_DESC_TYPE_CSI2,
+};
+
+struct v4l2_mbus_frame_desc_entry_csi2 {
+	u8 vc;
+	u8 dt;
+};
+
+struct v4l2_mbus_frame_desc_entry {
+	enum v4l2_mbus_frame_desc_flags flags;
+	u32 stream;
+	u32 pixelcode;
+	u32 length;
+	union {
+		struct v4l2_mbus_frame_desc_entry_csi2 csi2;
+	} bus;
+};
+
+#define V4L2_FRAME_DESC_ENTRY_MAX	8
+
+struct v4l2_mbus_frame_desc {
+	enum v4l2_mbus_frame_desc_type type;
+	struct v4l2_mbus_frame_desc_entry entry[V4L2_FRAME_DESC_ENTRY_MAX];
+	unsigned short num_entries;
+};
+
+/* ------------------------------------------------------------------------
+ * V4L2 fwnode
+ */
+enum v4l2_fwnode_orientation {
+	V4L2_FWNODE_ORIENTATION_FRONT,
+	V4L2_FWNODE_ORIENTATION_BACK,
+	V4L2_FWNODE_ORIENTATION_EXTERNAL,
+};
+
+#define V4L2_FWNODE_PROPERTY_UNSET	(-1U)
+
+struct v4l2_fwnode_device_properties {
+	enum v4l2_fwnode_orientation orientation;
+	unsigned int rotation;
+};
+
+struct v4l2_fwnode_endpoint {
+	enum v4l2_mbus_type bus_type;
+	struct {
+		struct v4l2_mbus_config_mipi_csi2 mipi_csi2;
+	} bus;
+	u64 *link_frequencies;
+	unsigned int nr_of_link_frequencies;
+};
+
+int v4l2_fwnode_endpoint_alloc_parse(struct fwnode_handle *fwnode,
+				     struct v4l2_fwnode_endpoint *vep);
+void v4l2_fwnode_endpoint_free(struct v4l2_fwnode_endpoint *vep);
+int v4l2_fwnode_device_parse(struct device *dev,
+			     struct v4l2_fwnode_device_properties *props);
+
+/* ------------------------------------------------------------------------
+ * V4L2 controls
+ */
+struct v4l2_ctrl;
+struct v4l2_ctrl_handler;
+
+struct v4l2_ctrl_ops {
+	int (*g_volatile_ctrl)(struct v4l2_ctrl *ctrl);
+	int (*try_ctrl)(struct v4l2_ctrl *ctrl);
+	int (*s_ctrl)(struct v4l2_ctrl *ctrl);
+};
+
+struct v4l2_ctrl {
+	struct v4l2_ctrl_handler *handler;
+	const struct v4l2_ctrl_ops *ops;
+	u32 id;
+	const char *name;
+	enum v4l2_ctrl_type type;
+	s64 minimum, maximum, default_value;
+	u64 step;
+	u32 flags;
+	u64 menu_skip_mask;
+	const char * const *qmenu;
+	const s64 *qmenu_int;
+	void *priv;
+
+	bool is_new;
+	bool has_changed;
+
+	/* Set with v4l2_ctrl_cluster(), cluster[0] is the master; NULL alone */
+	struct v4l2_ctrl **cluster;
+	unsigned int ncontrols;
+
+	union {
+		s32 val;
+		s64 val64;
+	};
+	struct {
+		union {
+			s32 val;
+			s64 val64;
+		};
+	} cur;
+
+	/* Events that would have been queued to subscribers */
+	unsigned long ev_value;
+	unsigned long ev_range;
+	unsigned long ev_flags;
+	unsigned long s_ctrl_calls;
+};
+
+struct v4l2_ctrl_handler {
+	struct mutex _lock;
+	struct mutex *lock;
+	struct v4l2_ctrl **ctrls;
+	unsigned int nr_of_ctrls;
+	unsigned int alloc;
+	int error;
+};
+
+struct v4l2_ctrl_config {
+	const struct v4l2_ctrl_ops *ops;
+	const void *type_ops;
+	u32 id;
+	const char *name;
+	enum v4l2_ctrl_type type;
+	s64 min;
+	s64 max;
+	u64 step;
+	s64 def;
+	u32 dims[4];
+	u32 elem_size;
+	u32 flags;
+	u64 menu_skip_mask;
+	const char * const *qmenu;
+	const s64 *qmenu_int;
+	unsigned int is_private:1;
+};
+
+int v4l2_ctrl_handler_init(struct v4l2_ctrl_handler *hdl, unsigned int nr_of_controls_hint);
+void v4l2_ctrl_handler_free(struct v4l2_ctrl_handler *hdl);
+int __v4l2_ctrl_handler_setup(struct v4l2_ctrl_handler *hdl);
+int v4l2_ctrl_handler_setup(struct v4l2_ctrl_handler *hdl);
+
+struct v4l2_ctrl *v4l2_ctrl_new_std(struct v4l2_ctrl_handler *hdl,
+				    const struct v4l2_ctrl_ops *ops,
+				    u32 id, s64 min, s64 max, u64 step, s64 def);
+struct v4l2_ctrl *v4l2_ctrl_new_std_menu(struct v4l2_ctrl_handler *hdl,
+					 const struct v4l2_ctrl_ops *ops,
+					 u32 id, u8 max, u64 mask, u8 def);
+struct v4l2_ctrl *v4l2_ctrl_new_std_menu_items(struct v4l2_ctrl_handler *hdl,
+					       const struct v4l2_ctrl_ops *ops,
+					       u32 id, u8 max, u64 mask, u8 def,
+					       const char * const *qmenu);
+struct v4l2_ctrl *v4l2_ctrl_new_int_menu(struct v4l2_ctrl_handler *hdl,
+					 const struct v4l2_ctrl_ops *ops,
+					 u32 id, u8 max, u8 def, const s64 *qmenu_int);
+struct v4l2_ctrl *v4l2_ctrl_new_custom(struct v4l2_ctrl_handler *hdl,
+				       const struct v4l2_ctrl_config *cfg, void *priv);
+int v4l2_ctrl_new_fwnode_properties(struct v4l2_ctrl_handler *hdl,
+				    const struct v4l2_ctrl_ops *ctrl_ops,
+				    const struct v4l2_fwnode_device_properties *p);
+struct v4l2_ctrl *v4l2_ctrl_find(struct v4l2_ctrl_handler *hdl, u32 id);
+void v4l2_ctrl_cluster(unsigned int ncontrols, struct v4l2_ctrl **controls);
+
+int __v4l2_ctrl_modify_range(struct v4l2_ctrl *ctrl, s64 min, s64 max, u64 step, s64 def);
+int __v4l2_ctrl_s_ctrl(struct v4l2_ctrl *ctrl, s32 val);
+int __v4l2_ctrl_s_ctrl_int64(struct v4l2_ctrl *ctrl, s64 val);
+int v4l2_ctrl_s_ctrl(struct v4l2_ctrl *ctrl, s32 val);
+s32 v4l2_ctrl_g_ctrl(struct v4l2_ctrl *ctrl);
+void __v4l2_ctrl_grab(struct v4l2_ctrl *ctrl, bool grabbed);
+void v4l2_ctrl_activate(struct v4l2_ctrl *ctrl, bool active);
+
+/* VIDIOC_S_CTRL / VIDIOC_G_CTRL as seen from userspace */
+int host_ioctl_s_ctrl(struct v4l2_ctrl_handler *hdl, u32 id, s64 val);
+/* VIDIOC_S_EXT_CTRLS: validated up front, then set cluster by cluster in order */
+int host_ioctl_s_ext_ctrls(struct v4l2_ctrl_handler *hdl, const u32 *ids,
+			   const s64 *vals, unsigned int count);
+int host_ioctl_g_ctrl(struct v4l2_ctrl_handler *hdl, u32 id, s64 *val);
+int host_ioctl_queryctrl(struct v4l2_ctrl_handler *hdl, u32 id,
+			 struct v4l2_query_ext_ctrl *qc);
+
+/* ------------------------------------------------------------------------
+ * V4L2 subdev
+ */
+struct v4l2_subdev;
+struct v4l2_event_subscription;
+struct v4l2_fh;
+
+#define HOST_SUBDEV_MAX_PADS	4
+
+struct v4l2_subdev_state {
+	struct v4l2_mbus_framefmt fmt[HOST_SUBDEV_MAX_PADS];
+	struct v4l2_rect crop[HOST_SUBDEV_MAX_PADS];
+};
+
+static inline bool v4l2_rect_equal(const struct v4l2_rect *r1, const struct v4l2_rect *r2)
+{
+	return r1->width == r2->width && r1->height == r2->height &&
+	       r1->left == r2->left && r1->top == r2->top;
+}
+
+struct v4l2_subdev_fh {
+	struct v4l2_subdev_state *state;
+};
+
+#define v4l2_subdev_state_get_format(state, pad)	(&(state)->fmt[(pad)])
+#define v4l2_subdev_state_get_crop(state, pad)		(&(state)->crop[(pad)])
+
+struct v4l2_subdev_core_ops {
+	long (*ioctl)(struct v4l2_subdev *sd, unsigned int cmd, void *arg);
+	int (*subscribe_event)(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+			       struct v4l2_event_subscription *sub);
+	int (*unsubscribe_event)(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				 struct v4l2_event_subscription *sub);
+};
+
+struct v4l2_subdev_video_ops {
+	int (*s_stream)(struct v4l2_subdev *sd, int enable);
+};
+
+struct v4l2_subdev_pad_ops {
+	int (*enum_mbus_code)(struct v4l2_subdev *sd, struct v4l2_subdev_state *state,
+			      struct v4l2_subdev_mbus_code_enum *code);
+	int (*enum_frame_size)(struct v4l2_subdev *sd, struct v4l2_subdev_state *state,
+			       struct v4l2_subdev_frame_size_enum *fse);
+	int (*get_fmt)(struct v4l2_subdev *sd, struct v4l2_subdev_state *state,
+		       struct v4l2_subdev_format *format);
+	int (*set_fmt)(struct v4l2_subdev *sd, struct v4l2_subdev_state *state,
+		       struct v4l2_subdev_format *format);
+	int (*get_selection)(struct v4l2_subdev *sd, struct v4l2_subdev_state *state,
+			     struct v4l2_subdev_selection *sel);
+	int (*set_selection)(struct v4l2_subdev *sd, struct v4l2_subdev_state *state,
+			     struct v4l2_subdev_selection *sel);
+	int (*get_frame_desc)(struct v4l2_subdev *sd, unsigned int pad,
+			      struct v4l2_mbus_frame_desc *fd);
+	int (*get_mbus_config)(struct v4l2_subdev *sd, unsigned int pad,
+			       struct v4l2_mbus_config *config);
+};
+
+struct v4l2_subdev_sensor_ops {
+	int (*g_skip_frames)(struct v4l2_subdev *sd, u32 *frames);
+};
+
+struct v4l2_subdev_ops {
+	const struct v4l2_subdev_core_ops *core;
+	const struct v4l2_subdev_video_ops *video;
+	const struct v4l2_subdev_pad_ops *pad;
+	const struct v4l2_subdev_sensor_ops *sensor;
+};
+
+struct v4l2_subdev_internal_ops {
+	int (*open)(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh);
+	int (*close)(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh);
+};
+
+#define V4L2_SUBDEV_FL_HAS_DEVNODE	BIT(2)
+#define V4L2_SUBDEV_FL_HAS_EVENTS	BIT(3)
+
+struct v4l2_subdev {
+	struct media_entity entity;
+	const struct v4l2_subdev_ops *ops;
+	const struct v4l2_subdev_internal_ops *internal_ops;
+	struct v4l2_ctrl_handler *ctrl_handler;
+	char name[52];
+	u32 flags;
+	struct device *dev;
+	void *dev_priv;
+	bool registered;
+	/* v4l2_subdev_notify_event() calls, by event type */
+	unsigned long host_src_change_events;
+};
+
+static inline void *v4l2_get_subdevdata(const struct v4l2_subdev *sd)
+{
+	return sd->dev_priv;
+}
+
+static inline void v4l2_set_subdevdata(struct v4l2_subdev *sd, void *p)
+{
+	sd->dev_priv = p;
+}
+
+void v4l2_i2c_subdev_init(struct v4l2_subdev *sd, struct i2c_client *client,
+			  const struct v4l2_subdev_ops *ops);
+int v4l2_async_register_subdev_sensor(struct v4l2_subdev *sd);
+void v4l2_async_unregister_subdev(struct v4l2_subdev *sd);
+
+int v4l2_ctrl_subdev_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				     struct v4l2_event_subscription *sub);
+int v4l2_event_subdev_unsubscribe(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				  struct v4l2_event_subscription *sub);
+int v4l2_src_change_event_subdev_subscribe(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+					   struct v4l2_event_subscription *sub);
+void v4l2_subdev_notify_event(struct v4l2_subdev *sd, const struct v4l2_event *ev);
+
+const void *__v4l2_find_nearest_size(const void *array, size_t array_size,
+				     size_t entry_size, size_t width_offset,
+				     size_t height_offset, s32 width, s32 height);
+
+#define v4l2_find_nearest_size(array, array_size, width_field, height_field, width, height) \
+	((__typeof__(&(array)[0]))__v4l2_find_nearest_size(			\
+		(array), array_size, sizeof(*(array)),				\
+		offsetof(__typeof__(*(array)), width_field),			\
+		offsetof(__typeof__(*(array)), height_field),			\
+		width, height))
+
+/* ------------------------------------------------------------------------
+ * debugfs and seq_file. Files are kept in a registry and read back with
+ * host_debugfs_read(), there is no VFS.
+ */
+#define __user
+
+struct inode {
+	void *i_private;
+};
+
+struct file {
+	void *private_data;
+	loff_t f_pos;
+};
+
+struct file_operations {
+	void *owner;
+	int (*open)(struct inode *inode, struct file *file);
+	ssize_t (*read)(struct file *file, char __user *buf, size_t count, loff_t *ppos);
+	loff_t (*llseek)(struct file *file, loff_t offset, int whence);
+	int (*release)(struct inode *inode, struct file *file);
+};
+
+struct dentry;
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+struct dentry *debugfs_create_file(const char *name, unsigned short mode,
+				   struct dentry *parent, void *data,
+				   const struct file_operations *fops);
+void debugfs_remove_recursive(struct dentry *dentry);
+
+/* Read all of "dir/name" into a malloc()ed buffer, returns the length */
+ssize_t host_debugfs_read(const char *path, char **out);
+
+ssize_t simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos,
+				const void *from, size_t available);
+loff_t default_llseek(struct file *file, loff_t offset, int whence);
+
+struct seq_file {
+	char *buf;
+	size_t size;
+	size_t count;
+	void *private;
+	int (*show)(struct seq_file *s, void *v);
+};
+
+void seq_printf(struct seq_file *s, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void seq_puts(struct seq_file *s, const char *str);
+int single_open(struct file *file, int (*show)(struct seq_file *, void *), void *data);
+ssize_t seq_read(struct file *file, char __user *buf, size_t count, loff_t *ppos);
+loff_t seq_lseek(struct file *file, loff_t offset, int whence);
+int single_release(struct inode *inode, struct file *file);
+
+#define DEFINE_SHOW_ATTRIBUTE(__name)						\
+static int __name ## _open(struct inode *inode, struct file *file)		\
+{										\
+	return single_open(file, __name ## _show, inode->i_private);		\
+}										\
+										\
+static const struct file_operations __name ## _fops = {			\
+	.owner		= THIS_MODULE,						\
+	.open		= __name ## _open,					\
+	.read		= seq_read,						\
+	.llseek		= seq_lseek,						\
+	.release	= single_release,					\
+}
+
+#endif /* __IMX678_HOST_KSHIM_H */
@@ -0,0 +1,1937 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Kernel API shim for the imx678 host build.
+ *
+ * The control emulation follows mainline v4l2-ctrls: integer values are
+ * clamped to the range, menu values outside it or skipped are rejected,
+ * s_ctrl() only runs when the value changes, modify_range() only raises a
+ * range event when something actually changed, and handler setup walks
+ * the controls in creation order skipping read-only ones.
+ */
+#include <time.h>
+#include <unistd.h>
+
+#include "kshim.h"
+
+int host_log_level = HOST_LOG_WARN;
+bool host_real_sleep;
+
+/* ------------------------------------------------------------------------
+ * Logging
+ */
+void host_dev_printk(int level, const struct device *dev, const char *fmt, ...)
+{
+	static const char * const tag[] = { "err", "warn", "info", "dbg" };
+	char buf[512];
+	const char *s;
+	size_t n = 0;
+	va_list ap;
+
+	if (level > host_log_level)
+		return;
+
+	/* %pe has no libc equivalent, print the pointer value instead */
+	for (s = fmt; *s && n < sizeof(buf) - 1; s++) {
+		buf[n++] = *s;
+		if (s[0] == '%' && s[1] == 'p' && s[2] == 'e') {
+			buf[n++] = 'p';
+			s += 2;
+		}
+	}
+	buf[n] = '\0';
+
+	fprintf(stderr, "[%s] %s: ", tag[level], dev ? dev_name(dev) : "kernel");
+	va_start(ap, fmt);
+	vfprintf(stderr, buf, ap);
+	va_end(ap);
+}
+
+/* ------------------------------------------------------------------------
+ * Locking
+ */
+void mutex_init(struct mutex *m)
+{
+	pthread_mutex_init(&m->lock, NULL);
+	m->held = false;
+}
+
+void mutex_destroy(struct mutex *m)
+{
+	pthread_mutex_destroy(&m->lock);
+}
+
+void mutex_lock(struct mutex *m)
+{
+	pthread_mutex_lock(&m->lock);
+	__atomic_store_n(&m->owner, pthread_self(), __ATOMIC_RELAXED);
+	__atomic_store_n(&m->held, true, __ATOMIC_RELEASE);
+}
+
+void mutex_unlock(struct mutex *m)
+{
+	__atomic_store_n(&m->held, false, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&m->lock);
+}
+
+bool host_mutex_is_owner(struct mutex *m)
+{
+	return __atomic_load_n(&m->held, __ATOMIC_ACQUIRE) &&
+	       pthread_equal(__atomic_load_n(&m->owner, __ATOMIC_RELAXED), pthread_self());
+}
+
+void host_lockdep_fail(const char *what, const char *file, int line)
+{
+	fprintf(stderr, "lockdep: %s not held at %s:%d\n", what, file, line);
+	abort();
+}
+
+/* ------------------------------------------------------------------------
+ * Time
+ */
+static u64 host_sleep_total;
+
+void host_delay_us(unsigned long us)
+{
+	__atomic_add_fetch(&host_sleep_total, us, __ATOMIC_RELAXED);
+	if (host_real_sleep)
+		usleep(us);
+}
+
+u64 host_slept_us(void)
+{
+	return __atomic_load_n(&host_sleep_total, __ATOMIC_RELAXED);
+}
+
+u64 ktime_get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec +
+	       (host_real_sleep ? 0 : host_slept_us() * 1000);
+}
+
+/*
+ * data_race(): the copy is allowed to tear, the caller validates it
+ * afterwards, so keep TSan from reporting it.
+ */
+__attribute__((no_sanitize_thread))
+void host_racy_copy(void *dst, const void *src, size_t len)
+{
+	volatile const unsigned char *s = src;
+	unsigned char *d = dst;
+
+	while (len--)
+		*d++ = *s++;
+}
+
+/* ------------------------------------------------------------------------
+ * hrtimers and workqueues
+ */
+static pthread_mutex_t host_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t host_timer_cond;
+static struct hrtimer *host_timers;
+static pthread_once_t host_timer_once = PTHREAD_ONCE_INIT;
+
+static void host_cond_wait_ns(pthread_cond_t *cond, pthread_mutex_t *lock, u64 ns)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_nsec += ns % 1000000000ULL;
+	ts.tv_sec += ns / 1000000000ULL + ts.tv_nsec / 1000000000L;
+	ts.tv_nsec %= 1000000000L;
+	pthread_cond_timedwait(cond, lock, &ts);
+}
+
+static void host_cond_init(pthread_cond_t *cond)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+static void *host_timer_thread(void *arg)
+{
+	pthread_mutex_lock(&host_timer_lock);
+	for (;;) {
+		struct hrtimer *t, *first = NULL, **pp;
+		u64 now = ktime_get_ns();
+
+		for (t = host_timers; t; t = t->next)
+			if (!first || t->expires < first->expires)
+				first = t;
+
+		if (!first || (u64)first->expires > now) {
+			/* Virtual sleeps move the clock, so poll at least every ms */
+			u64 wait = first ? min_t(u64, first->expires - now, 1000000) : 1000000;
+
+			host_cond_wait_ns(&host_timer_cond, &host_timer_lock, wait);
+			continue;
+		}
+
+		for (pp = &host_timers; *pp != first; pp = &(*pp)->next)
+			;
+		*pp = first->next;
+		first->queued = false;
+		first->running = true;
+		pthread_mutex_unlock(&host_timer_lock);
+
+		first->function(first);
+
+		pthread_mutex_lock(&host_timer_lock);
+		first->running = false;
+		pthread_cond_broadcast(&host_timer_cond);
+	}
+
+	return NULL;
+}
+
+static void host_timer_start_thread(void)
+{
+	pthread_t thread;
+
+	host_cond_init(&host_timer_cond);
+	pthread_create(&thread, NULL, host_timer_thread, NULL);
+	pthread_detach(thread);
+}
+
+void hrtimer_init(struct hrtimer *timer, int clock_id, enum hrtimer_mode mode)
+{
+	memset(timer, 0, sizeof(*timer));
+	pthread_once(&host_timer_once, host_timer_start_thread);
+}
+
+static bool host_timer_dequeue(struct hrtimer *timer)
+{
+	struct hrtimer **pp;
+
+	if (!timer->queued)
+		return false;
+
+	for (pp = &host_timers; *pp != timer; pp = &(*pp)->next)
+		;
+	*pp = timer->next;
+	timer->queued = false;
+
+	return true;
+}
+
+void hrtimer_start(struct hrtimer *timer, ktime_t tim, enum hrtimer_mode mode)
+{
+	pthread_mutex_lock(&host_timer_lock);
+	host_timer_dequeue(timer);
+	timer->expires = mode == HRTIMER_MODE_REL ? (ktime_t)ktime_get_ns() + tim : tim;
+	timer->queued = true;
+	timer->next = host_timers;
+	host_timers = timer;
+	pthread_cond_broadcast(&host_timer_cond);
+	pthread_mutex_unlock(&host_timer_lock);
+}
+
+int hrtimer_try_to_cancel(struct hrtimer *timer)
+{
+	int ret;
+
+	pthread_mutex_lock(&host_timer_lock);
+	ret = timer->running ? -1 : host_timer_dequeue(timer);
+	pthread_mutex_unlock(&host_timer_lock);
+
+	return ret;
+}
+
+int hrtimer_cancel(struct hrtimer *timer)
+{
+	int ret;
+
+	pthread_mutex_lock(&host_timer_lock);
+	ret = host_timer_dequeue(timer);
+	while (timer->running)
+		pthread_cond_wait(&host_timer_cond, &host_timer_lock);
+	pthread_mutex_unlock(&host_timer_lock);
+
+	return ret;
+}
+
+struct workqueue_struct {
+	int unused;
+};
+
+static struct workqueue_struct host_wq;
+struct workqueue_struct *system_wq = &host_wq;
+struct workqueue_struct *system_highpri_wq = &host_wq;
+
+static pthread_mutex_t host_work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t host_work_cond = PTHREAD_COND_INITIALIZER;
+static struct work_struct *host_works, *host_work_running;
+static pthread_once_t host_work_once = PTHREAD_ONCE_INIT;
+
+static void *host_work_thread(void *arg)
+{
+	pthread_mutex_lock(&host_work_lock);
+	for (;;) {
+		struct work_struct *work = host_works;
+
+		if (!work) {
+			pthread_cond_wait(&host_work_cond, &host_work_lock);
+			continue;
+		}
+
+		host_works = work->next;
+		work->pending = false;
+		host_work_running = work;
+		pthread_mutex_unlock(&host_work_lock);
+
+		work->func(work);
+
+		pthread_mutex_lock(&host_work_lock);
+		host_work_running = NULL;
+		pthread_cond_broadcast(&host_work_cond);
+	}
+
+	return NULL;
+}
+
+static void host_work_start_thread(void)
+{
+	pthread_t thread;
+
+	pthread_create(&thread, NULL, host_work_thread, NULL);
+	pthread_detach(thread);
+}
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+	struct work_struct **pp;
+	bool queued = false;
+
+	pthread_once(&host_work_once, host_work_start_thread);
+
+	pthread_mutex_lock(&host_work_lock);
+	if (!work->pending) {
+		for (pp = &host_works; *pp; pp = &(*pp)->next)
+			;
+		work->next = NULL;
+		work->pending = true;
+		*pp = work;
+		queued = true;
+		pthread_cond_broadcast(&host_work_cond);
+	}
+	pthread_mutex_unlock(&host_work_lock);
+
+	return queued;
+}
+
+bool cancel_work_sync(struct work_struct *work)
+{
+	struct work_struct **pp;
+	bool pending;
+
+	pthread_mutex_lock(&host_work_lock);
+	pending = work->pending;
+	if (pending) {
+		for (pp = &host_works; *pp != work; pp = &(*pp)->next)
+			;
+		*pp = work->next;
+		work->pending = false;
+	}
+	while (host_work_running == work)
+		pthread_cond_wait(&host_work_cond, &host_work_lock);
+	pthread_mutex_unlock(&host_work_lock);
+
+	return pending;
+}
+
+/* ------------------------------------------------------------------------
+ * Managed allocations, released by host_devres_release_all() after remove
+ */
+struct host_devres {
+	struct host_devres *next;
+	max_align_t data[];
+};
+
+void *devm_kzalloc(struct device *dev, size_t size, int flags)
+{
+	struct host_devres *dr = calloc(1, sizeof(*dr) + size);
+
+	if (!dr)
+		return NULL;
+	dr->next = dev->devres;
+	dev->devres = dr;
+
+	return dr->data;
+}
+
+void *devm_kcalloc(struct device *dev, size_t n, size_t size, int flags)
+{
+	return devm_kzalloc(dev, n * size, flags);
+}
+
+void devm_kfree(struct device *dev, void *p)
+{
+	struct host_devres **pp;
+
+	for (pp = &dev->devres; *pp; pp = &(*pp)->next) {
+		if ((void *)(*pp)->data == p) {
+			struct host_devres *dr = *pp;
+
+			*pp = dr->next;
+			free(dr);
+			return;
+		}
+	}
+}
+
+void host_devres_release_all(struct device *dev)
+{
+	while (dev->devres) {
+		struct host_devres *dr = dev->devres;
+
+		dev->devres = dr->next;
+		free(dr);
+	}
+}
+
+/* ------------------------------------------------------------------------
+ * Device tree
+ */
+const struct property *of_find_property(const struct device_node *np, const char *name)
+{
+	unsigned int i;
+
+	if (!np)
+		return NULL;
+
+	for (i = 0; i < np->num_props; i++)
+		if (!strcmp(np->props[i].name, name))
+			return &np->props[i];
+
+	return NULL;
+}
+
+bool of_property_read_bool(const struct device_node *np, const char *name)
+{
+	return of_find_property(np, name);
+}
+
+bool of_property_present(const struct device_node *np, const char *name)
+{
+	return of_find_property(np, name);
+}
+
+int of_property_read_u32_array(const struct device_node *np, const char *name,
+			       u32 *vals, size_t n)
+{
+	const struct property *p = of_find_property(np, name);
+
+	if (!p)
+		return -EINVAL;
+	if (!p->u32s)
+		return -ENODATA;
+	if (p->n < n)
+		return -EOVERFLOW;
+
+	memcpy(vals, p->u32s, n * sizeof(*vals));
+
+	return 0;
+}
+
+int of_property_read_u32(const struct device_node *np, const char *name, u32 *val)
+{
+	return of_property_read_u32_array(np, name, val, 1);
+}
+
+int of_property_read_string(const struct device_node *np, const char *name,
+			    const char **out)
+{
+	const struct property *p = of_find_property(np, name);
+
+	if (!p)
+		return -EINVAL;
+	if (!p->str)
+		return -EILSEQ;
+
+	*out = p->str;
+
+	return 0;
+}
+
+const struct of_device_id *of_match_device(const struct of_device_id *matches,
+					   const struct device *dev)
+{
+	const char *compatible;
+
+	if (of_property_read_string(dev->of_node, "compatible", &compatible))
+		return NULL;
+
+	for (; matches->compatible[0]; matches++)
+		if (!strcmp(matches->compatible, compatible))
+			return matches;
+
+	return NULL;
+}
+
+const void *i2c_get_match_data(const struct i2c_client *client)
+{
+	const struct i2c_driver *drv;
+	const struct of_device_id *match;
+	const struct i2c_device_id *id;
+
+	if (!client->dev.driver)
+		return NULL;
+	drv = container_of(client->dev.driver, struct i2c_driver, driver);
+
+	if (drv->driver.of_match_table && client->dev.of_node) {
+		match = of_match_device(drv->driver.of_match_table, &client->dev);
+		if (match)
+			return match->data;
+	}
+
+	for (id = drv->id_table; id && id->name[0]; id++)
+		if (!strcmp(id->name, client->name))
+			return (const void *)id->driver_data;
+
+	return NULL;
+}
+
+struct fwnode_handle *fwnode_graph_get_next_endpoint(struct fwnode_handle *fwnode,
+						     struct fwnode_handle *prev)
+{
+	if (!fwnode || prev || !fwnode->ep)
+		return NULL;
+
+	return fwnode;
+}
+
+int v4l2_fwnode_endpoint_alloc_parse(struct fwnode_handle *fwnode,
+				     struct v4l2_fwnode_endpoint *vep)
+{
+	const struct host_endpoint *ep = fwnode->ep;
+	unsigned int i;
+
+	if (vep->bus_type != V4L2_MBUS_CSI2_DPHY)
+		return -ENXIO;
+
+	memset(&vep->bus, 0, sizeof(vep->bus));
+	vep->bus.mipi_csi2.num_data_lanes = ep->num_data_lanes;
+	for (i = 0; i < ep->num_data_lanes; i++)
+		vep->bus.mipi_csi2.data_lanes[i] = i + 1;
+	if (ep->clock_noncontinuous)
+		vep->bus.mipi_csi2.flags |= V4L2_MBUS_CSI2_NONCONTINUOUS_CLOCK;
+
+	vep->nr_of_link_frequencies = ep->nr_of_link_frequencies;
+	vep->link_frequencies = NULL;
+	if (ep->nr_of_link_frequencies) {
+		vep->link_frequencies = calloc(ep->nr_of_link_frequencies, sizeof(u64));
+		if (!vep->link_frequencies)
+			return -ENOMEM;
+		memcpy(vep->link_frequencies, ep->link_frequencies,
+		       ep->nr_of_link_frequencies * sizeof(u64));
+	}
+
+	return 0;
+}
+
+void v4l2_fwnode_endpoint_free(struct v4l2_fwnode_endpoint *vep)
+{
+	free(vep->link_frequencies);
+	vep->link_frequencies = NULL;
+}
+
+int v4l2_fwnode_device_parse(struct device *dev,
+			     struct v4l2_fwnode_device_properties *props)
+{
+	u32 val;
+
+	memset(props, 0, sizeof(*props));
+	props->orientation = V4L2_FWNODE_PROPERTY_UNSET;
+	props->rotation = V4L2_FWNODE_PROPERTY_UNSET;
+
+	if (!of_property_read_u32(dev->of_node, "orientation", &val))
+		props->orientation = val;
+	if (!of_property_read_u32(dev->of_node, "rotation", &val))
+		props->rotation = val;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * Clock, regulator, GPIO
+ */
+unsigned long host_xclk_rate = 24000000;
+
+struct clk *devm_clk_get(struct device *dev, const char *id)
+{
+	struct clk *clk = devm_kzalloc(dev, sizeof(*clk), GFP_KERNEL);
+
+	if (!clk)
+		return ERR_PTR(-ENOMEM);
+	clk->rate = host_xclk_rate;
+	dev->clk = clk;
+
+	return clk;
+}
+
+unsigned long clk_get_rate(struct clk *clk)
+{
+	return clk->rate;
+}
+
+int clk_prepare_enable(struct clk *clk)
+{
+	clk->enable_count++;
+
+	return 0;
+}
+
+void clk_disable_unprepare(struct clk *clk)
+{
+	if (WARN_ON(clk->enable_count <= 0))
+		return;
+	clk->enable_count--;
+}
+
+int devm_regulator_bulk_get(struct device *dev, int num, struct regulator_bulk_data *consumers)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		consumers[i].consumer = devm_kzalloc(dev, sizeof(struct regulator), GFP_KERNEL);
+		if (!consumers[i].consumer)
+			return -ENOMEM;
+		dev->regulator = consumers[i].consumer;
+	}
+
+	return 0;
+}
+
+int regulator_bulk_enable(int num, struct regulator_bulk_data *consumers)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+		consumers[i].consumer->enable_count++;
+
+	return 0;
+}
+
+int regulator_bulk_disable(int num, struct regulator_bulk_data *consumers)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+		if (!WARN_ON(consumers[i].consumer->enable_count <= 0))
+			consumers[i].consumer->enable_count--;
+
+	return 0;
+}
+
+struct gpio_desc *gpiod_get_optional(struct device *dev, const char *con_id,
+				     enum gpiod_flags flags)
+{
+	struct gpio_desc *desc;
+
+	/*
+	 * As gpiolib, a shared line keeps the level its first user set, and
+	 * every request returns the one descriptor that a single gpiod_put()
+	 * gives back.
+	 */
+	if (dev->of_node && dev->of_node->shared_reset) {
+		desc = dev->of_node->shared_reset;
+		if (!(flags & GPIOD_FLAGS_BIT_NONEXCLUSIVE))
+			return ERR_PTR(-EBUSY);
+		if (!desc->requested) {
+			desc->requested = true;
+			desc->value = (flags & ~GPIOD_FLAGS_BIT_NONEXCLUSIVE) == GPIOD_OUT_HIGH;
+		}
+		return desc;
+	}
+
+	desc = kzalloc(sizeof(*desc), GFP_KERNEL);
+	if (!desc)
+		return ERR_PTR(-ENOMEM);
+	desc->value = (flags & ~GPIOD_FLAGS_BIT_NONEXCLUSIVE) == GPIOD_OUT_HIGH;
+	desc->requested = true;
+	desc->allocated = true;
+
+	return desc;
+}
+
+void gpiod_put(struct gpio_desc *desc)
+{
+	if (!desc || WARN_ON(!desc->requested))
+		return;
+
+	desc->requested = false;
+	if (desc->allocated)
+		kfree(desc);
+}
+
+void gpiod_set_value_cansleep(struct gpio_desc *desc, int value)
+{
+	if (desc && !WARN_ON(!desc->requested))
+		desc->value = !!value;
+}
+
+/* ------------------------------------------------------------------------
+ * I2C
+ */
+int i2c_transfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	int ret;
+
+	mutex_lock(&adap->bus_lock);
+	ret = adap->algo->master_xfer(adap, msgs, num);
+	mutex_unlock(&adap->bus_lock);
+
+	return ret;
+}
+
+int i2c_master_send(const struct i2c_client *client, const char *buf, int count)
+{
+	struct i2c_msg msg = {
+		.addr = client->addr,
+		.len = count,
+		.buf = (u8 *)buf,
+	};
+	int ret;
+
+	ret = i2c_transfer(client->adapter, &msg, 1);
+
+	return ret == 1 ? count : ret;
+}
+
+/* ------------------------------------------------------------------------
+ * Runtime PM
+ */
+static int host_rpm_resume(struct device *dev)
+{
+	int ret;
+
+	if (dev->pm_active)
+		return 1;
+	if (!dev->pm_enabled)
+		return -EACCES;
+
+	ret = dev->driver->pm->runtime_resume(dev);
+	if (ret)
+		return ret;
+	dev->pm_active = true;
+	dev->pm_resumes++;
+
+	return 0;
+}
+
+static int host_rpm_suspend(struct device *dev)
+{
+	int ret;
+
+	if (!dev->pm_active || !dev->pm_enabled || dev->pm_usage > 0)
+		return 0;
+
+	ret = dev->driver->pm->runtime_suspend(dev);
+	if (ret)
+		return ret;
+	dev->pm_active = false;
+	dev->pm_suspends++;
+
+	return 0;
+}
+
+int pm_runtime_get_sync(struct device *dev)
+{
+	int ret;
+
+	mutex_lock(&dev->pm_lock);
+	dev->pm_usage++;
+	ret = host_rpm_resume(dev);
+	mutex_unlock(&dev->pm_lock);
+
+	return ret;
+}
+
+int pm_runtime_resume_and_get(struct device *dev)
+{
+	int ret = pm_runtime_get_sync(dev);
+
+	if (ret < 0) {
+		pm_runtime_put_noidle(dev);
+		return ret;
+	}
+
+	return 0;
+}
+
+int pm_runtime_get_if_in_use(struct device *dev)
+{
+	int ret = 0;
+
+	mutex_lock(&dev->pm_lock);
+	if (!dev->pm_enabled) {
+		ret = -EINVAL;
+	} else if (dev->pm_active && dev->pm_usage > 0) {
+		dev->pm_usage++;
+		ret = 1;
+	}
+	mutex_unlock(&dev->pm_lock);
+
+	return ret;
+}
+
+int pm_runtime_put(struct device *dev)
+{
+	int ret = 0;
+
+	mutex_lock(&dev->pm_lock);
+	if (!WARN_ON(dev->pm_usage <= 0) && --dev->pm_usage == 0)
+		ret = host_rpm_suspend(dev);
+	mutex_unlock(&dev->pm_lock);
+
+	return ret;
+}
+
+int pm_runtime_put_sync(struct device *dev)
+{
+	return pm_runtime_put(dev);
+}
+
+void pm_runtime_put_noidle(struct device *dev)
+{
+	mutex_lock(&dev->pm_lock);
+	if (!WARN_ON(dev->pm_usage <= 0))
+		dev->pm_usage--;
+	mutex_unlock(&dev->pm_lock);
+}
+
+void pm_runtime_get_noresume(struct device *dev)
+{
+	mutex_lock(&dev->pm_lock);
+	dev->pm_usage++;
+	mutex_unlock(&dev->pm_lock);
+}
+
+int pm_runtime_set_active(struct device *dev)
+{
+	dev->pm_active = true;
+
+	return 0;
+}
+
+void pm_runtime_set_suspended(struct device *dev)
+{
+	dev->pm_active = false;
+}
+
+void pm_runtime_enable(struct device *dev)
+{
+	dev->pm_enabled = true;
+}
+
+void pm_runtime_disable(struct device *dev)
+{
+	dev->pm_enabled = false;
+}
+
+int pm_runtime_idle(struct device *dev)
+{
+	int ret;
+
+	mutex_lock(&dev->pm_lock);
+	ret = host_rpm_suspend(dev);
+	mutex_unlock(&dev->pm_lock);
+
+	return ret;
+}
+
+bool pm_runtime_status_suspended(struct device *dev)
+{
+	return !dev->pm_active;
+}
+
+static bool host_pm_needs_force_resume;
+
+int pm_runtime_force_suspend(struct device *dev)
+{
+	int ret = 0;
+
+	mutex_lock(&dev->pm_lock);
+	dev->pm_enabled = false;
+	if (dev->pm_active) {
+		ret = dev->driver->pm->runtime_suspend(dev);
+		if (!ret) {
+			dev->pm_active = false;
+			dev->pm_suspends++;
+			host_pm_needs_force_resume = dev->pm_usage > 0;
+		}
+	}
+	if (ret)
+		dev->pm_enabled = true;
+	mutex_unlock(&dev->pm_lock);
+
+	return ret;
+}
+
+int pm_runtime_force_resume(struct device *dev)
+{
+	int ret = 0;
+
+	mutex_lock(&dev->pm_lock);
+	if (host_pm_needs_force_resume) {
+		ret = dev->driver->pm->runtime_resume(dev);
+		if (!ret) {
+			dev->pm_active = true;
+			dev->pm_resumes++;
+		}
+		host_pm_needs_force_resume = false;
+	}
+	dev->pm_enabled = true;
+	mutex_unlock(&dev->pm_lock);
+
+	return ret;
+}
+
+void device_enable_async_suspend(struct device *dev)
+{
+	dev->pm_async = true;
+}
+
+/* ------------------------------------------------------------------------
+ * Media / subdev
+ */
+int media_entity_pads_init(struct media_entity *entity, u16 num_pads, struct media_pad *pads)
+{
+	if (num_pads > HOST_SUBDEV_MAX_PADS)
+		return -E2BIG;
+	entity->num_pads = num_pads;
+	entity->pads = pads;
+
+	return 0;
+}
+
+void v4l2_i2c_subdev_init(struct v4l2_subdev *sd, struct i2c_client *client,
+			  const struct v4l2_subdev_ops *ops)
+{
+	memset(sd, 0, sizeof(*sd));
+	sd->ops = ops;
+	sd->dev = &client->dev;
+	v4l2_set_subdevdata(sd, client);
+	i2c_set_clientdata(client, sd);
+	snprintf(sd->name, sizeof(sd->name), "%s %s", client->name, dev_name(&client->dev));
+}
+
+int v4l2_async_register_subdev_sensor(struct v4l2_subdev *sd)
+{
+	sd->registered = true;
+
+	return 0;
+}
+
+void v4l2_async_unregister_subdev(struct v4l2_subdev *sd)
+{
+	sd->registered = false;
+}
+
+int v4l2_ctrl_subdev_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				     struct v4l2_event_subscription *sub)
+{
+	return 0;
+}
+
+int v4l2_event_subdev_unsubscribe(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				  struct v4l2_event_subscription *sub)
+{
+	return 0;
+}
+
+int v4l2_src_change_event_subdev_subscribe(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+					   struct v4l2_event_subscription *sub)
+{
+	return 0;
+}
+
+void v4l2_subdev_notify_event(struct v4l2_subdev *sd, const struct v4l2_event *ev)
+{
+	if (ev->type == V4L2_EVENT_SOURCE_CHANGE)
+		__atomic_add_fetch(&sd->host_src_change_events, 1, __ATOMIC_RELAXED);
+}
+
+const void *__v4l2_find_nearest_size(const void *array, size_t array_size,
+				     size_t entry_size, size_t width_offset,
+				     size_t height_offset, s32 width, s32 height)
+{
+	u32 error, min_error = U32_MAX;
+	const void *best = NULL;
+	unsigned int i;
+
+	if (!array)
+		return NULL;
+
+	for (i = 0; i < array_size; i++, array = (const char *)array + entry_size) {
+		const u32 *entry_width = (const u32 *)((const char *)array + width_offset);
+		const u32 *entry_height = (const u32 *)((const char *)array + height_offset);
+
+		error = abs((int)(*entry_width - width)) + abs((int)(*entry_height - height));
+		if (error > min_error)
+			continue;
+
+		min_error = error;
+		best = array;
+		if (!error)
+			break;
+	}
+
+	return best;
+}
+
+/* ------------------------------------------------------------------------
+ * Controls
+ */
+static void host_ctrl_event(struct v4l2_ctrl *ctrl, u32 changes)
+{
+	if (changes & V4L2_EVENT_CTRL_CH_VALUE)
+		ctrl->ev_value++;
+	if (changes & V4L2_EVENT_CTRL_CH_RANGE)
+		ctrl->ev_range++;
+	if (changes & V4L2_EVENT_CTRL_CH_FLAGS)
+		ctrl->ev_flags++;
+}
+
+static s64 host_ctrl_cur(const struct v4l2_ctrl *ctrl)
+{
+	return ctrl->type == V4L2_CTRL_TYPE_INTEGER64 ? ctrl->cur.val64 : ctrl->cur.val;
+}
+
+static s64 host_ctrl_new(const struct v4l2_ctrl *ctrl)
+{
+	return ctrl->type == V4L2_CTRL_TYPE_INTEGER64 ? ctrl->val64 : ctrl->val;
+}
+
+static void host_ctrl_set_new(struct v4l2_ctrl *ctrl, s64 val)
+{
+	if (ctrl->type == V4L2_CTRL_TYPE_INTEGER64)
+		ctrl->val64 = val;
+	else
+		ctrl->val = (s32)val;
+}
+
+static void cur_to_new(struct v4l2_ctrl *ctrl)
+{
+	host_ctrl_set_new(ctrl, host_ctrl_cur(ctrl));
+}
+
+/* std_validate_elem() */
+static int validate_new(struct v4l2_ctrl *ctrl)
+{
+	s64 val = host_ctrl_new(ctrl);
+	s64 offset;
+
+	switch (ctrl->type) {
+	case V4L2_CTRL_TYPE_INTEGER:
+	case V4L2_CTRL_TYPE_INTEGER64:
+		if (val < ctrl->minimum)
+			val = ctrl->minimum;
+		if (val > ctrl->maximum)
+			val = ctrl->maximum;
+		if (ctrl->step > 1) {
+			offset = val - ctrl->minimum;
+			offset = ctrl->step * ((offset + (s64)ctrl->step / 2) / (s64)ctrl->step);
+			val = ctrl->minimum + offset;
+			if (val > ctrl->maximum)
+				val -= ctrl->step;
+		}
+		host_ctrl_set_new(ctrl, val);
+		return 0;
+
+	case V4L2_CTRL_TYPE_BOOLEAN:
+		ctrl->val = !!ctrl->val;
+		return 0;
+
+	case V4L2_CTRL_TYPE_BUTTON:
+		ctrl->val = 0;
+		return 0;
+
+	case V4L2_CTRL_TYPE_MENU:
+	case V4L2_CTRL_TYPE_INTEGER_MENU:
+		if (val < ctrl->minimum || val > ctrl->maximum)
+			return -ERANGE;
+		if (val < 64 && (ctrl->menu_skip_mask & BIT_ULL(val)))
+			return -EINVAL;
+		return 0;
+
+	default:
+		return 0;
+	}
+}
+
+/*
+ * try_or_set_cluster() + new_to_cur(): the members flagged is_new carry
+ * their new values, the others their current ones. One s_ctrl call on the
+ * master for the whole cluster, as with the real framework.
+ */
+static int set_cluster(struct v4l2_ctrl *master, u32 ch_flags)
+{
+	struct v4l2_ctrl **c = master->cluster ?: &master;
+	unsigned int n = master->cluster ? master->ncontrols : 1;
+	bool changed = false;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < n && !ret; i++)
+		if (c[i] && c[i]->is_new)
+			ret = validate_new(c[i]);
+	if (ret)
+		goto restore;
+
+	for (i = 0; i < n; i++) {
+		if (!c[i])
+			continue;
+		c[i]->has_changed = c[i]->is_new &&
+				    (host_ctrl_new(c[i]) != host_ctrl_cur(c[i]) ||
+				     (c[i]->flags & V4L2_CTRL_FLAG_EXECUTE_ON_WRITE));
+		changed |= c[i]->has_changed;
+	}
+
+	if (changed && master->ops && master->ops->s_ctrl) {
+		master->s_ctrl_calls++;
+		ret = master->ops->s_ctrl(master);
+	}
+	if (ret)
+		goto restore;
+
+	for (i = 0; i < n; i++) {
+		if (!c[i] || !c[i]->is_new)
+			continue;
+		if (c[i]->has_changed) {
+			if (c[i]->type == V4L2_CTRL_TYPE_INTEGER64)
+				c[i]->cur.val64 = c[i]->val64;
+			else
+				c[i]->cur.val = c[i]->val;
+		}
+		if (c[i]->has_changed || ch_flags)
+			host_ctrl_event(c[i], (c[i]->has_changed ? V4L2_EVENT_CTRL_CH_VALUE : 0) |
+				       ch_flags);
+		c[i]->is_new = false;
+	}
+
+	return 0;
+
+restore:
+	for (i = 0; i < n; i++) {
+		if (!c[i])
+			continue;
+		cur_to_new(c[i]);
+		c[i]->is_new = false;
+	}
+
+	return ret;
+}
+
+/* Reset the cluster of @ctrl to its current values, for @ctrl to be set */
+static struct v4l2_ctrl *prepare_cluster(struct v4l2_ctrl *ctrl)
+{
+	struct v4l2_ctrl *master = ctrl->cluster ? ctrl->cluster[0] : ctrl;
+	struct v4l2_ctrl **c = master->cluster ?: &master;
+	unsigned int n = master->cluster ? master->ncontrols : 1;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (c[i] && c[i] != ctrl) {
+			cur_to_new(c[i]);
+			c[i]->is_new = false;
+		}
+	}
+
+	return master;
+}
+
+/* @ctrl carries its new value */
+static int set_ctrl(struct v4l2_ctrl *ctrl, u32 ch_flags)
+{
+	struct v4l2_ctrl *master = prepare_cluster(ctrl);
+
+	ctrl->is_new = true;
+
+	return set_cluster(master, ch_flags);
+}
+
+void v4l2_ctrl_cluster(unsigned int ncontrols, struct v4l2_ctrl **controls)
+{
+	unsigned int i;
+
+	for (i = 0; i < ncontrols; i++) {
+		if (controls[i]) {
+			controls[i]->cluster = controls;
+			controls[i]->ncontrols = ncontrols;
+		}
+	}
+}
+
+int v4l2_ctrl_handler_init(struct v4l2_ctrl_handler *hdl, unsigned int nr_of_controls_hint)
+{
+	memset(hdl, 0, sizeof(*hdl));
+	mutex_init(&hdl->_lock);
+	hdl->lock = &hdl->_lock;
+	hdl->alloc = nr_of_controls_hint ? nr_of_controls_hint : 8;
+	hdl->ctrls = calloc(hdl->alloc, sizeof(*hdl->ctrls));
+	if (!hdl->ctrls)
+		hdl->error = -ENOMEM;
+
+	return hdl->error;
+}
+
+void v4l2_ctrl_handler_free(struct v4l2_ctrl_handler *hdl)
+{
+	unsigned int i;
+
+	if (!hdl->ctrls)
+		return;
+
+	for (i = 0; i < hdl->nr_of_ctrls; i++)
+		free(hdl->ctrls[i]);
+	free(hdl->ctrls);
+	hdl->ctrls = NULL;
+	hdl->nr_of_ctrls = 0;
+	mutex_destroy(&hdl->_lock);
+}
+
+int __v4l2_ctrl_handler_setup(struct v4l2_ctrl_handler *hdl)
+{
+	unsigned int i;
+	int ret = 0;
+
+	lockdep_assert_held(hdl->lock);
+
+	for (i = 0; i < hdl->nr_of_ctrls; i++) {
+		struct v4l2_ctrl *ctrl = hdl->ctrls[i];
+		struct v4l2_ctrl **c = ctrl->cluster ?: &ctrl;
+		unsigned int n = ctrl->cluster ? ctrl->ncontrols : 1;
+		unsigned int j;
+
+		if (ctrl->type == V4L2_CTRL_TYPE_BUTTON ||
+		    (ctrl->flags & V4L2_CTRL_FLAG_READ_ONLY))
+			continue;
+		if (!ctrl->ops || !ctrl->ops->s_ctrl)
+			continue;
+		/* Clusters are set up once, through their master */
+		if (c[0] != ctrl)
+			continue;
+
+		for (j = 0; j < n; j++) {
+			if (c[j]) {
+				cur_to_new(c[j]);
+				c[j]->is_new = true;
+			}
+		}
+		ctrl->s_ctrl_calls++;
+		ret = ctrl->ops->s_ctrl(ctrl);
+		for (j = 0; j < n; j++)
+			if (c[j])
+				c[j]->is_new = false;
+		if (ret)
+			break;
+	}
+
+	return ret;
+}
+
+int v4l2_ctrl_handler_setup(struct v4l2_ctrl_handler *hdl)
+{
+	int ret;
+
+	mutex_lock(hdl->lock);
+	ret = __v4l2_ctrl_handler_setup(hdl);
+	mutex_unlock(hdl->lock);
+
+	return ret;
+}
+
+static struct v4l2_ctrl *v4l2_ctrl_new(struct v4l2_ctrl_handler *hdl,
+				       const struct v4l2_ctrl_ops *ops,
+				       u32 id, const char *name, enum v4l2_ctrl_type type,
+				       s64 min, s64 max, u64 step, s64 def, u32 flags,
+				       u64 menu_skip_mask, const char * const *qmenu,
+				       const s64 *qmenu_int, void *priv)
+{
+	struct v4l2_ctrl *ctrl;
+
+	if (hdl->error)
+		return NULL;
+
+	if (min > max || def < min || def > max) {
+		hdl->error = -ERANGE;
+		return NULL;
+	}
+
+	if (v4l2_ctrl_find(hdl, id)) {
+		hdl->error = -EEXIST;
+		return NULL;
+	}
+
+	if (hdl->nr_of_ctrls == hdl->alloc) {
+		struct v4l2_ctrl **n = realloc(hdl->ctrls, 2 * hdl->alloc * sizeof(*n));
+
+		if (!n) {
+			hdl->error = -ENOMEM;
+			return NULL;
+		}
+		hdl->ctrls = n;
+		hdl->alloc *= 2;
+	}
+
+	ctrl = calloc(1, sizeof(*ctrl));
+	if (!ctrl) {
+		hdl->error = -ENOMEM;
+		return NULL;
+	}
+
+	if (type == V4L2_CTRL_TYPE_BUTTON)
+		flags |= V4L2_CTRL_FLAG_WRITE_ONLY | V4L2_CTRL_FLAG_EXECUTE_ON_WRITE;
+
+	ctrl->handler = hdl;
+	ctrl->ops = ops;
+	ctrl->id = id;
+	ctrl->name = name;
+	ctrl->type = type;
+	ctrl->minimum = min;
+	ctrl->maximum = max;
+	ctrl->step = step;
+	ctrl->default_value = def;
+	ctrl->flags = flags;
+	ctrl->menu_skip_mask = menu_skip_mask;
+	ctrl->qmenu = qmenu;
+	ctrl->qmenu_int = qmenu_int;
+	ctrl->priv = priv;
+	if (type == V4L2_CTRL_TYPE_INTEGER64)
+		ctrl->val64 = ctrl->cur.val64 = def;
+	else
+		ctrl->val = ctrl->cur.val = (s32)def;
+
+	hdl->ctrls[hdl->nr_of_ctrls++] = ctrl;
+
+	return ctrl;
+}
+
+/* The subset of v4l2_ctrl_fill() for the standard controls sensors use */
+static void v4l2_ctrl_fill(u32 id, const char **name, enum v4l2_ctrl_type *type, u32 *flags)
+{
+	*type = V4L2_CTRL_TYPE_INTEGER;
+	*flags = 0;
+
+	switch (id) {
+	case V4L2_CID_PIXEL_RATE:
+		*name = "Pixel Rate";
+		*type = V4L2_CTRL_TYPE_INTEGER64;
+		*flags = V4L2_CTRL_FLAG_READ_ONLY;
+		break;
+	case V4L2_CID_LINK_FREQ:
+		*name = "Link Frequency";
+		*type = V4L2_CTRL_TYPE_INTEGER_MENU;
+		*flags = V4L2_CTRL_FLAG_READ_ONLY;
+		break;
+	case V4L2_CID_HFLIP:
+		*name = "Horizontal Flip";
+		*type = V4L2_CTRL_TYPE_BOOLEAN;
+		break;
+	case V4L2_CID_VFLIP:
+		*name = "Vertical Flip";
+		*type = V4L2_CTRL_TYPE_BOOLEAN;
+		break;
+	case V4L2_CID_TEST_PATTERN:
+		*name = "Test Pattern";
+		*type = V4L2_CTRL_TYPE_MENU;
+		break;
+	case V4L2_CID_CAMERA_ORIENTATION:
+		*name = "Camera Orientation";
+		*type = V4L2_CTRL_TYPE_MENU;
+		*flags = V4L2_CTRL_FLAG_READ_ONLY;
+		break;
+	case V4L2_CID_CAMERA_SENSOR_ROTATION:
+		*name = "Camera Sensor Rotation";
+		*flags = V4L2_CTRL_FLAG_READ_ONLY;
+		break;
+	case V4L2_CID_VBLANK:
+		*name = "Vertical Blanking";
+		break;
+	case V4L2_CID_HBLANK:
+		*name = "Horizontal Blanking";
+		break;
+	case V4L2_CID_EXPOSURE:
+		*name = "Exposure";
+		break;
+	case V4L2_CID_ANALOGUE_GAIN:
+		*name = "Analogue Gain";
+		break;
+	case V4L2_CID_BRIGHTNESS:
+		*name = "Brightness";
+		break;
+	default:
+		*name = "Unknown";
+		break;
+	}
+}
+
+struct v4l2_ctrl *v4l2_ctrl_new_std(struct v4l2_ctrl_handler *hdl,
+				    const struct v4l2_ctrl_ops *ops,
+				    u32 id, s64 min, s64 max, u64 step, s64 def)
+{
+	enum v4l2_ctrl_type type;
+	const char *name;
+	u32 flags;
+
+	v4l2_ctrl_fill(id, &name, &type, &flags);
+	if (type == V4L2_CTRL_TYPE_MENU || type == V4L2_CTRL_TYPE_INTEGER_MENU) {
+		hdl->error = -EINVAL;
+		return NULL;
+	}
+
+	return v4l2_ctrl_new(hdl, ops, id, name, type, min, max, step, def, flags,
+			     0, NULL, NULL, NULL);
+}
+
+struct v4l2_ctrl *v4l2_ctrl_new_std_menu_items(struct v4l2_ctrl_handler *hdl,
+					       const struct v4l2_ctrl_ops *ops,
+					       u32 id, u8 max, u64 mask, u8 def,
+					       const char * const *qmenu)
+{
+	enum v4l2_ctrl_type type;
+	const char *name;
+	u32 flags;
+
+	v4l2_ctrl_fill(id, &name, &type, &flags);
+	if (type != V4L2_CTRL_TYPE_MENU) {
+		hdl->error = -EINVAL;
+		return NULL;
+	}
+
+	return v4l2_ctrl_new(hdl, ops, id, name, type, 0, max, 0, def, flags,
+			     mask, qmenu, NULL, NULL);
+}
+
+struct v4l2_ctrl *v4l2_ctrl_new_std_menu(struct v4l2_ctrl_handler *hdl,
+					 const struct v4l2_ctrl_ops *ops,
+					 u32 id, u8 max, u64 mask, u8 def)
+{
+	return v4l2_ctrl_new_std_menu_items(hdl, ops, id, max, mask, def, NULL);
+}
+
+struct v4l2_ctrl *v4l2_ctrl_new_int_menu(struct v4l2_ctrl_handler *hdl,
+					 const struct v4l2_ctrl_ops *ops,
+					 u32 id, u8 max, u8 def, const s64 *qmenu_int)
+{
+	enum v4l2_ctrl_type type;
+	const char *name;
+	u32 flags;
+
+	v4l2_ctrl_fill(id, &name, &type, &flags);
+
+	return v4l2_ctrl_new(hdl, ops, id, name, V4L2_CTRL_TYPE_INTEGER_MENU,
+			     0, max, 0, def, flags, 0, NULL, qmenu_int, NULL);
+}
+
+struct v4l2_ctrl *v4l2_ctrl_new_custom(struct v4l2_ctrl_handler *hdl,
+				       const struct v4l2_ctrl_config *cfg, void *priv)
+{
+	return v4l2_ctrl_new(hdl, cfg->ops, cfg->id, cfg->name, cfg->type,
+			     cfg->min, cfg->max, cfg->step, cfg->def, cfg->flags,
+			     cfg->menu_skip_mask, cfg->qmenu, cfg->qmenu_int, priv);
+}
+
+int v4l2_ctrl_new_fwnode_properties(struct v4l2_ctrl_handler *hdl,
+				    const struct v4l2_ctrl_ops *ctrl_ops,
+				    const struct v4l2_fwnode_device_properties *p)
+{
+	if (hdl->error)
+		return hdl->error;
+
+	if ((u32)p->orientation != V4L2_FWNODE_PROPERTY_UNSET)
+		v4l2_ctrl_new_std_menu(hdl, ctrl_ops, V4L2_CID_CAMERA_ORIENTATION,
+				       V4L2_CAMERA_ORIENTATION_EXTERNAL, 0, p->orientation);
+
+	if (p->rotation != V4L2_FWNODE_PROPERTY_UNSET)
+		v4l2_ctrl_new_std(hdl, ctrl_ops, V4L2_CID_CAMERA_SENSOR_ROTATION,
+				  p->rotation, p->rotation, 1, p->rotation);
+
+	return hdl->error;
+}
+
+struct v4l2_ctrl *v4l2_ctrl_find(struct v4l2_ctrl_handler *hdl, u32 id)
+{
+	unsigned int i;
+
+	for (i = 0; i < hdl->nr_of_ctrls; i++)
+		if (hdl->ctrls[i]->id == id)
+			return hdl->ctrls[i];
+
+	return NULL;
+}
+
+int __v4l2_ctrl_modify_range(struct v4l2_ctrl *ctrl, s64 min, s64 max, u64 step, s64 def)
+{
+	bool range_changed = false;
+
+	lockdep_assert_held(ctrl->handler->lock);
+
+	if (min > max || def < min || def > max)
+		return -ERANGE;
+
+	if (ctrl->minimum != min || ctrl->maximum != max ||
+	    ctrl->step != step || ctrl->default_value != def) {
+		range_changed = true;
+		ctrl->minimum = min;
+		ctrl->maximum = max;
+		ctrl->step = step;
+		ctrl->default_value = def;
+	}
+
+	cur_to_new(ctrl);
+	if (validate_new(ctrl))
+		host_ctrl_set_new(ctrl, def);
+
+	if (host_ctrl_new(ctrl) != host_ctrl_cur(ctrl))
+		return set_ctrl(ctrl, V4L2_EVENT_CTRL_CH_RANGE);
+	if (range_changed)
+		host_ctrl_event(ctrl, V4L2_EVENT_CTRL_CH_RANGE);
+
+	return 0;
+}
+
+int __v4l2_ctrl_s_ctrl(struct v4l2_ctrl *ctrl, s32 val)
+{
+	lockdep_assert_held(ctrl->handler->lock);
+
+	ctrl->val = val;
+
+	return set_ctrl(ctrl, 0);
+}
+
+int __v4l2_ctrl_s_ctrl_int64(struct v4l2_ctrl *ctrl, s64 val)
+{
+	lockdep_assert_held(ctrl->handler->lock);
+
+	ctrl->val64 = val;
+
+	return set_ctrl(ctrl, 0);
+}
+
+int v4l2_ctrl_s_ctrl(struct v4l2_ctrl *ctrl, s32 val)
+{
+	int ret;
+
+	mutex_lock(ctrl->handler->lock);
+	ret = __v4l2_ctrl_s_ctrl(ctrl, val);
+	mutex_unlock(ctrl->handler->lock);
+
+	return ret;
+}
+
+s32 v4l2_ctrl_g_ctrl(struct v4l2_ctrl *ctrl)
+{
+	s32 val;
+
+	mutex_lock(ctrl->handler->lock);
+	val = ctrl->cur.val;
+	mutex_unlock(ctrl->handler->lock);
+
+	return val;
+}
+
+void __v4l2_ctrl_grab(struct v4l2_ctrl *ctrl, bool grabbed)
+{
+	u32 old;
+
+	if (!ctrl)
+		return;
+
+	lockdep_assert_held(ctrl->handler->lock);
+
+	old = ctrl->flags;
+	if (grabbed)
+		ctrl->flags |= V4L2_CTRL_FLAG_GRABBED;
+	else
+		ctrl->flags &= ~V4L2_CTRL_FLAG_GRABBED;
+	if (old != ctrl->flags)
+		host_ctrl_event(ctrl, V4L2_EVENT_CTRL_CH_FLAGS);
+}
+
+void v4l2_ctrl_activate(struct v4l2_ctrl *ctrl, bool active)
+{
+	u32 old;
+
+	if (!ctrl)
+		return;
+
+	old = ctrl->flags;
+	if (active)
+		ctrl->flags &= ~V4L2_CTRL_FLAG_INACTIVE;
+	else
+		ctrl->flags |= V4L2_CTRL_FLAG_INACTIVE;
+	if (old != ctrl->flags)
+		host_ctrl_event(ctrl, V4L2_EVENT_CTRL_CH_FLAGS);
+}
+
+int host_ioctl_s_ctrl(struct v4l2_ctrl_handler *hdl, u32 id, s64 val)
+{
+	struct v4l2_ctrl *ctrl = v4l2_ctrl_find(hdl, id);
+	int ret;
+
+	if (!ctrl)
+		return -EINVAL;
+
+	mutex_lock(hdl->lock);
+	if (ctrl->flags & V4L2_CTRL_FLAG_READ_ONLY) {
+		ret = -EACCES;
+	} else if (ctrl->flags & V4L2_CTRL_FLAG_GRABBED) {
+		ret = -EBUSY;
+	} else {
+		host_ctrl_set_new(ctrl, val);
+		ret = set_ctrl(ctrl, 0);
+	}
+	mutex_unlock(hdl->lock);
+
+	return ret;
+}
+
+int host_ioctl_s_ext_ctrls(struct v4l2_ctrl_handler *hdl, const u32 *ids,
+			   const s64 *vals, unsigned int count)
+{
+	struct v4l2_ctrl *ctrl, *master;
+	unsigned int i, j;
+	int ret = 0;
+
+	mutex_lock(hdl->lock);
+	for (i = 0; i < count && !ret; i++) {
+		ctrl = v4l2_ctrl_find(hdl, ids[i]);
+		if (!ctrl)
+			ret = -EINVAL;
+		else if (ctrl->flags & V4L2_CTRL_FLAG_READ_ONLY)
+			ret = -EACCES;
+		else if (ctrl->flags & V4L2_CTRL_FLAG_GRABBED)
+			ret = -EBUSY;
+	}
+
+	/*
+	 * try_set_ext_ctrls_common(): the values of a cluster are copied in
+	 * just before it is set, a later cluster still has its old values.
+	 */
+	for (i = 0; i < count && !ret; i++) {
+		ctrl = v4l2_ctrl_find(hdl, ids[i]);
+		master = ctrl->cluster ? ctrl->cluster[0] : ctrl;
+
+		for (j = 0; j < i; j++) {
+			struct v4l2_ctrl *prev = v4l2_ctrl_find(hdl, ids[j]);
+
+			if ((prev->cluster ? prev->cluster[0] : prev) == master)
+				break;
+		}
+		if (j < i)
+			continue;
+
+		prepare_cluster(ctrl);
+		for (j = i; j < count; j++) {
+			struct v4l2_ctrl *next = v4l2_ctrl_find(hdl, ids[j]);
+
+			if ((next->cluster ? next->cluster[0] : next) == master) {
+				host_ctrl_set_new(next, vals[j]);
+				next->is_new = true;
+			}
+		}
+		ret = set_cluster(master, 0);
+	}
+	mutex_unlock(hdl->lock);
+
+	return ret;
+}
+
+int host_ioctl_queryctrl(struct v4l2_ctrl_handler *hdl, u32 id,
+			 struct v4l2_query_ext_ctrl *qc)
+{
+	struct v4l2_ctrl *ctrl = v4l2_ctrl_find(hdl, id);
+
+	if (!ctrl)
+		return -EINVAL;
+
+	memset(qc, 0, sizeof(*qc));
+	mutex_lock(hdl->lock);
+	qc->id = ctrl->id;
+	qc->type = ctrl->type;
+	qc->minimum = ctrl->minimum;
+	qc->maximum = ctrl->maximum;
+	qc->step = ctrl->step;
+	qc->default_value = ctrl->default_value;
+	qc->flags = ctrl->flags;
+	mutex_unlock(hdl->lock);
+
+	return 0;
+}
+
+int host_ioctl_g_ctrl(struct v4l2_ctrl_handler *hdl, u32 id, s64 *val)
+{
+	struct v4l2_ctrl *ctrl = v4l2_ctrl_find(hdl, id);
+
+	if (!ctrl)
+		return -EINVAL;
+	if (ctrl->flags & V4L2_CTRL_FLAG_WRITE_ONLY)
+		return -EACCES;
+
+	mutex_lock(hdl->lock);
+	*val = host_ctrl_cur(ctrl);
+	mutex_unlock(hdl->lock);
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------
+ * debugfs and seq_file
+ */
+struct dentry {
+	struct dentry *next;
+	struct dentry *parent;
+	char name[64];
+	const struct file_operations *fops;	/* NULL for directories */
+	void *data;
+};
+
+static struct dentry *host_debugfs;
+static pthread_mutex_t host_debugfs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct dentry *host_debugfs_add(const char *name, struct dentry *parent,
+				       void *data, const struct file_operations *fops)
+{
+	struct dentry *d = calloc(1, sizeof(*d));
+
+	if (!d)
+		return ERR_PTR(-ENOMEM);
+
+	snprintf(d->name, sizeof(d->name), "%s", name);
+	d->parent = parent;
+	d->data = data;
+	d->fops = fops;
+
+	pthread_mutex_lock(&host_debugfs_lock);
+	d->next = host_debugfs;
+	host_debugfs = d;
+	pthread_mutex_unlock(&host_debugfs_lock);
+
+	return d;
+}
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+	return host_debugfs_add(name, parent, NULL, NULL);
+}
+
+struct dentry *debugfs_create_file(const char *name, unsigned short mode,
+				   struct dentry *parent, void *data,
+				   const struct file_operations *fops)
+{
+	return host_debugfs_add(name, parent, data, fops);
+}
+
+static bool host_dentry_under(const struct dentry *d, const struct dentry *root)
+{
+	for (; d; d = d->parent)
+		if (d == root)
+			return true;
+
+	return false;
+}
+
+void debugfs_remove_recursive(struct dentry *dentry)
+{
+	struct dentry **pp, *d;
+
+	if (IS_ERR_OR_NULL(dentry))
+		return;
+
+	/* Children were added after their parent, so they come first */
+	pthread_mutex_lock(&host_debugfs_lock);
+	for (pp = &host_debugfs; (d = *pp);) {
+		if (host_dentry_under(d, dentry) && d != dentry) {
+			*pp = d->next;
+			free(d);
+		} else {
+			pp = &d->next;
+		}
+	}
+	for (pp = &host_debugfs; (d = *pp); pp = &d->next) {
+		if (d == dentry) {
+			*pp = d->next;
+			free(d);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&host_debugfs_lock);
+}
+
+static bool host_dentry_match(const struct dentry *d, const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	size_t len;
+
+	if (!slash)
+		return !d->parent && !strcmp(d->name, path);
+	if (!d->parent || strcmp(d->name, slash + 1))
+		return false;
+
+	len = slash - path;
+	if (strlen(d->parent->name) == len && !strncmp(d->parent->name, path, len))
+		return !d->parent->parent;
+
+	return false;
+}
+
+ssize_t host_debugfs_read(const char *path, char **out)
+{
+	struct file file = { 0 };
+	struct inode inode;
+	struct dentry *d;
+	size_t size = 0, len = 0;
+	char *buf = NULL;
+	ssize_t ret;
+
+	pthread_mutex_lock(&host_debugfs_lock);
+	for (d = host_debugfs; d; d = d->next)
+		if (d->fops && host_dentry_match(d, path))
+			break;
+	pthread_mutex_unlock(&host_debugfs_lock);
+	if (!d)
+		return -ENOENT;
+
+	inode.i_private = d->data;
+	ret = d->fops->open ? d->fops->open(&inode, &file) : 0;
+	if (ret)
+		return ret;
+
+	do {
+		if (size - len < 4096) {
+			char *p = realloc(buf, size + 65536);
+
+			if (!p) {
+				ret = -ENOMEM;
+				break;
+			}
+			buf = p;
+			size += 65536;
+		}
+		ret = d->fops->read(&file, buf + len, size - len, &file.f_pos);
+		if (ret > 0)
+			len += ret;
+	} while (ret > 0);
+
+	if (d->fops->release)
+		d->fops->release(&inode, &file);
+
+	if (ret < 0) {
+		free(buf);
+		return ret;
+	}
+
+	*out = buf;
+
+	return len;
+}
+
+ssize_t simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos,
+				const void *from, size_t available)
+{
+	loff_t pos = *ppos;
+
+	if (pos < 0)
+		return -EINVAL;
+	if (pos >= available || !count)
+		return 0;
+
+	count = min_t(size_t, count, available - pos);
+	memcpy(to, (const char *)from + pos, count);
+	*ppos = pos + count;
+
+	return count;
+}
+
+loff_t default_llseek(struct file *file, loff_t offset, int whence)
+{
+	return -EINVAL;
+}
+
+void seq_printf(struct seq_file *s, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(s->buf + s->count, s->size - s->count, fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return;
+		if (s->count + n < s->size)
+			break;
+
+		char *p = realloc(s->buf, s->size * 2 + n + 1);
+
+		if (!p)
+			return;
+		s->buf = p;
+		s->size = s->size * 2 + n + 1;
+	}
+
+	s->count += n;
+}
+
+void seq_puts(struct seq_file *s, const char *str)
+{
+	seq_printf(s, "%s", str);
+}
+
+int single_open(struct file *file, int (*show)(struct seq_file *, void *), void *data)
+{
+	struct seq_file *s = calloc(1, sizeof(*s));
+
+	if (!s)
+		return -ENOMEM;
+
+	s->private = data;
+	s->show = show;
+	file->private_data = s;
+
+	return 0;
+}
+
+/* Unlike the kernel, show() runs once on the first read */
+ssize_t seq_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+
+	if (!s->buf) {
+		int ret;
+
+		s->buf = malloc(4096);
+		if (!s->buf)
+			return -ENOMEM;
+		s->size = 4096;
+		ret = s->show(s, NULL);
+		if (ret)
+			return ret;
+	}
+
+	return simple_read_from_buffer(buf, count, ppos, s->buf, s->count);
+}
+
+loff_t seq_lseek(struct file *file, loff_t offset, int whence)
+{
+	return -EINVAL;
+}
+
+int single_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *s = file->private_data;
+
+	free(s->buf);
+	free(s);
+
+	return 0;
+}
@@ -0,0 +1,854 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * imx678 host harness: runs the driver's probe, set_fmt, set_ctrl and
+ * stream paths in loops against the fake I2C bus and reports the cost per
+ * operation, for profiling the production code with perf, callgrind or
+ * the sanitizers.
+ */
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "harness.h"
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct bench {
+	const char *name;
+	int (*run)(struct host_sensor *s, unsigned long i);
+	bool needs_probe;
+	/* Cap for benches that run in real frame time, 0 for none */
+	unsigned long max_iters;
+	/* Runs after probe, before stream on for streaming benches */
+	int (*setup)(struct host_sensor *s);
+};
+
+/* Driver private control and the readout mode register */
+#define HOST_CID_SNAPSHOT	(V4L2_CID_USER_ASPEED_BASE + 10)
+#define HOST_CID_HCG		(V4L2_CID_USER_ASPEED_BASE + 6)
+#define HOST_CID_RAMP_EXPOSURE	(V4L2_CID_USER_ASPEED_BASE + 11)
+#define HOST_CID_RAMP_GAIN	(V4L2_CID_USER_ASPEED_BASE + 12)
+#define HOST_CID_RAMP_FRAMES	(V4L2_CID_USER_ASPEED_BASE + 13)
+#define HOST_CID_STOP_MODE	(V4L2_CID_USER_ASPEED_BASE + 14)
+#define HOST_CID_PRESET_SLOT	(V4L2_CID_USER_ASPEED_BASE + 15)
+#define HOST_CID_PRESET_SAVE	(V4L2_CID_USER_ASPEED_BASE + 16)
+#define HOST_CID_PRESET_APPLY	(V4L2_CID_USER_ASPEED_BASE + 17)
+#define HOST_CID_LINK_QUALIFY	(V4L2_CID_USER_ASPEED_BASE + 18)
+#define HOST_CID_LINK_TEST_PASS	(V4L2_CID_USER_ASPEED_BASE + 19)
+#define HOST_CID_LINK_TEST_FAIL	(V4L2_CID_USER_ASPEED_BASE + 20)
+#define HOST_RAMP_FRAMES	4
+#define HOST_GAIN_MIN_HCG	34
+#define HOST_REG_MODE_SELECT	0x3000
+#define HOST_XCLR_DELAY_US	500000
+#define HOST_REG_ADDMODE	0x301B
+#define HOST_REG_PIX_HST	0x303C
+#define HOST_REG_PIX_VST	0x3044
+#define HOST_REG_HOLD		0x3001
+#define HOST_REG_VMAX		0x3028
+#define HOST_REG_DATARATE_SEL	0x3015
+#define HOST_REG_TPG_EN		0x30E0
+
+/* Full resolution frame: active lines, and the ones a frame end stop adds */
+#define HOST_FULL_HEIGHT	2180
+#define HOST_STOP_MARGIN_LINES	32
+
+static struct host_sensor_cfg cfg;
+
+static int bench_probe(struct host_sensor *s, unsigned long i)
+{
+	int ret = host_sensor_probe(s, &cfg);
+
+	if (!ret)
+		host_sensor_remove(s);
+
+	return ret;
+}
+
+static int bench_set_fmt(struct host_sensor *s, unsigned long i)
+{
+	return i & 1 ? host_sensor_set_fmt(s, 3856, 2180) :
+		       host_sensor_set_fmt(s, 1928, 1090);
+}
+
+static int bench_set_ctrl(struct host_sensor *s, unsigned long i)
+{
+	int ret;
+
+	ret = host_sensor_s_ctrl(s, V4L2_CID_VBLANK, 1200 + (i % 64) * 16);
+	ret = ret ?: host_sensor_s_ctrl(s, V4L2_CID_EXPOSURE, 8 + (i % 1000));
+	ret = ret ?: host_sensor_s_ctrl(s, V4L2_CID_ANALOGUE_GAIN, i % 240);
+
+	return ret;
+}
+
+static int bench_set_ctrl_streaming(struct host_sensor *s, unsigned long i)
+{
+	return bench_set_ctrl(s, i);
+}
+
+/*
+ * Internal sync: only the first frame, exposed before stream on, is
+ * dropped. A snapshot would change the frame size under a receiver that
+ * was not declared to follow it.
+ */
+static int bench_stream(struct host_sensor *s, unsigned long i)
+{
+	int ret = host_sensor_s_stream(s, 1);
+	u32 skip;
+
+	ret = ret ?: s->sd->ops->sensor->g_skip_frames(s->sd, &skip);
+	if (!ret && skip != 1)
+		ret = -EIO;
+	if (!ret && !cfg.mid_stream_resize &&
+	    host_sensor_s_ctrl(s, HOST_CID_SNAPSHOT, 1) != -EBUSY)
+		ret = -EIO;
+
+	return ret ?: host_sensor_s_stream(s, 0);
+}
+
+static u32 mode_select(struct host_sensor *s)
+{
+	u32 val;
+
+	mutex_lock(&s->bus.adap.bus_lock);
+	val = fake_i2c_peek(&s->bus, HOST_REG_MODE_SELECT, 1);
+	mutex_unlock(&s->bus.adap.bus_lock);
+
+	return val;
+}
+
+static int stop_setup(struct host_sensor *s)
+{
+	return host_sensor_set_fmt(s, 3856, 2180);
+}
+
+/*
+ * Stream on and off with each stop mode in turn, stopping somewhere else
+ * in the frame every time. Immediate is standby on return, waiting for
+ * the frame end returns no earlier than the end of the readout, and the
+ * deferred stop returns during the readout with the sensor still
+ * streaming, then writes standby and drops runtime PM from its timer.
+ */
+static int bench_stop(struct host_sensor *s, unsigned long i)
+{
+	u32 mode = i % 3;
+	struct host_history_entry *e;
+	u64 base, frame_ns, line_ns, readout_ns, phase, wait, t0, t1;
+	s64 vblank;
+	int ret, n;
+
+	ret = host_sensor_s_ctrl(s, HOST_CID_STOP_MODE, mode);
+	ret = ret ?: host_sensor_g_ctrl(s, V4L2_CID_VBLANK, &vblank);
+	ret = ret ?: host_sensor_s_stream(s, 1);
+	if (ret)
+		return ret;
+
+	/* Frame 0 starts with the stream on record */
+	n = host_sensor_history(s, &e);
+	if (n < 0)
+		return n;
+	base = e[n - 1].timestamp_ns;
+	frame_ns = (u64)e[n - 1].vmax * e[n - 1].hmax * 1000000 / 74250;
+	free(e);
+	line_ns = frame_ns / (HOST_FULL_HEIGHT + vblank);
+	readout_ns = frame_ns * (HOST_FULL_HEIGHT + HOST_STOP_MARGIN_LINES) /
+		     (HOST_FULL_HEIGHT + vblank);
+
+	host_delay_us((i * 7919) % (frame_ns / 1000));
+
+	t0 = ktime_get_ns();
+	ret = host_sensor_s_stream(s, 0);
+	t1 = ktime_get_ns();
+	if (ret)
+		return ret;
+
+	phase = (t0 - base) % frame_ns;
+	wait = phase < readout_ns ? readout_ns - phase : 0;
+
+	switch (mode) {
+	case 0:
+		if (mode_select(s) != 1)
+			ret = -EIO;
+		break;
+	case 1:
+		if (mode_select(s) != 1 || t1 - t0 + line_ns < wait)
+			ret = -EIO;
+		break;
+	case 2:
+		if (t1 - t0 + line_ns < wait && mode_select(s) != 0)
+			ret = -EIO;
+		ret = ret ?: host_sensor_wait_idle(s, 1000);
+		if (!ret && mode_select(s) != 1)
+			ret = -EIO;
+		break;
+	}
+
+	return ret;
+}
+
+/*
+ * Two instances on one XCLR line. The second stream on finds the line
+ * released, but its supplies only come up then, so it still waits a full
+ * XCLR delay of its own. The line stays released until the last of them
+ * powers off and stays requested until the last of them is removed,
+ * whichever probed first.
+ */
+static int bench_shared_xclr(struct host_sensor *s, unsigned long i)
+{
+	struct host_sensor_cfg c = cfg;
+	struct gpio_desc line = { 0 };
+	struct host_sensor *b = calloc(1, sizeof(*b));
+	u64 slept;
+	int ret;
+
+	if (!b)
+		return -ENOMEM;
+
+	c.shared_reset = &line;
+	ret = host_sensor_probe(s, &c);
+	if (ret)
+		goto out_free;
+	ret = host_sensor_probe(b, &c);
+	if (ret)
+		goto out_remove;
+
+	ret = host_sensor_s_stream(s, 1);
+	slept = host_slept_us();
+	ret = ret ?: host_sensor_s_stream(b, 1);
+	slept = host_slept_us() - slept;
+	if (!ret && !cfg.standby_retention && slept < HOST_XCLR_DELAY_US)
+		ret = -EIO;
+
+	host_sensor_s_stream(s, 0);
+	if (!ret && !line.value)
+		ret = -EIO;
+	host_sensor_s_stream(b, 0);
+	if (!ret && !cfg.standby_retention && line.value)
+		ret = -EIO;
+
+	host_sensor_remove(s);
+	if (!ret && !line.requested)
+		ret = -EIO;
+	host_sensor_remove(b);
+	if (!ret && line.requested)
+		ret = -EIO;
+	goto out_free;
+
+out_remove:
+	host_sensor_remove(s);
+out_free:
+	free(b);
+
+	return ret;
+}
+
+static int bench_history(struct host_sensor *s, unsigned long i)
+{
+	struct host_history_entry *e;
+	int ret, n;
+
+	ret = host_sensor_s_ctrl(s, V4L2_CID_EXPOSURE, 8 + (i % 1000));
+	if (ret)
+		return ret;
+
+	n = host_sensor_history(s, &e);
+	if (n < 0)
+		return n;
+	/* Stream on plus one record per exposure change, until the ring wraps */
+	if (e[n - 1].index != i + 1 || e[n - 1].shr == 0)
+		ret = -EIO;
+	free(e);
+
+	return ret;
+}
+
+/* Range events raised since the last call, worst control */
+static unsigned long range_events(struct host_sensor *s, unsigned long *last)
+{
+	struct v4l2_ctrl_handler *hdl = s->sd->ctrl_handler;
+	unsigned long worst = 0;
+	unsigned int c;
+
+	for (c = 0; c < hdl->nr_of_ctrls; c++) {
+		worst = max(worst, hdl->ctrls[c]->ev_range - last[c]);
+		last[c] = hdl->ctrls[c]->ev_range;
+	}
+
+	return worst;
+}
+
+/*
+ * At most one range event per control for a format change or a VBLANK
+ * write, none for writes that leave the limits alone. The blanking only
+ * reaches s_ctrl() while powered, so the writes are made streaming.
+ */
+static int bench_ctrl_events(struct host_sensor *s, unsigned long i)
+{
+	unsigned long last[64] = { 0 };
+	int ret;
+
+	if (s->sd->ctrl_handler->nr_of_ctrls > ARRAY_SIZE(last))
+		return -E2BIG;
+	range_events(s, last);
+
+	ret = bench_set_fmt(s, i);
+	if (!ret && range_events(s, last) > 1)
+		return -EIO;
+
+	ret = ret ?: host_sensor_s_stream(s, 1);
+	range_events(s, last);
+
+	ret = ret ?: host_sensor_s_ctrl(s, V4L2_CID_VBLANK, 1200 + (i % 64) * 16);
+	if (!ret && range_events(s, last) > 1)
+		ret = -EIO;
+
+	/* The odd line is dropped from VMAX, so the exposure limit stays */
+	ret = ret ?: host_sensor_s_ctrl(s, V4L2_CID_EXPOSURE, 8 + (i % 1000));
+	ret = ret ?: host_sensor_s_ctrl(s, V4L2_CID_ANALOGUE_GAIN, i % 240);
+	ret = ret ?: host_sensor_s_ctrl(s, V4L2_CID_VBLANK, 1201 + (i % 64) * 16);
+	if (!ret && range_events(s, last))
+		ret = -EIO;
+
+	host_sensor_s_stream(s, 0);
+
+	return ret;
+}
+
+static u32 addmode(struct host_sensor *s)
+{
+	u32 val;
+
+	mutex_lock(&s->bus.adap.bus_lock);
+	val = fake_i2c_peek(&s->bus, HOST_REG_ADDMODE, 1);
+	mutex_unlock(&s->bus.adap.bus_lock);
+
+	return val;
+}
+
+/*
+ * Ramp up with HCG on on even iterations, and down through the HCG
+ * minimum on odd ones. The history must show at most one step per frame,
+ * gain moving towards the target and never below the HCG minimum with HCG
+ * on. A step whose timer fires late lands one frame later, which a loaded
+ * host does, so frames may be skipped.
+ */
+static int bench_ramp(struct host_sensor *s, unsigned long i)
+{
+	bool down = i & 1;
+	s64 exposure = down ? 200 : 1800;
+	s64 gain = down ? 10 : 120;
+	/* The frame count ahead of the targets it is clustered with */
+	const u32 ids[] = { HOST_CID_RAMP_FRAMES, HOST_CID_RAMP_EXPOSURE, HOST_CID_RAMP_GAIN };
+	const s64 vals[] = { HOST_RAMP_FRAMES, exposure, gain };
+	struct host_history_entry *e;
+	s64 val;
+	int ret, n, k;
+
+	ret = down ? 0 : host_sensor_s_ctrl(s, HOST_CID_HCG, 1);
+	ret = ret ?: host_sensor_s_ctrls(s, ids, vals, ARRAY_SIZE(ids));
+	if (ret)
+		return ret;
+
+	do {
+		usleep(1000);
+		ret = host_sensor_g_ctrl(s, HOST_CID_RAMP_FRAMES, &val);
+	} while (!ret && val);
+
+	ret = ret ?: host_sensor_g_ctrl(s, V4L2_CID_EXPOSURE, &val);
+	if (!ret && val != exposure)
+		ret = -EIO;
+	ret = ret ?: host_sensor_g_ctrl(s, V4L2_CID_ANALOGUE_GAIN, &val);
+	if (!ret && val != gain)
+		ret = -EIO;
+	if (ret)
+		return ret;
+
+	n = host_sensor_history(s, &e);
+	if (n < HOST_RAMP_FRAMES)
+		return n < 0 ? n : -EIO;
+	for (k = n - HOST_RAMP_FRAMES; k < n; k++) {
+		if (e[k].hcg && e[k].gain < HOST_GAIN_MIN_HCG)
+			ret = -EIO;
+		if (k > n - HOST_RAMP_FRAMES &&
+		    (e[k].frame_seq <= e[k - 1].frame_seq ||
+		     (down ? e[k].gain > e[k - 1].gain : e[k].gain < e[k - 1].gain)))
+			ret = -EIO;
+	}
+	if (e[n - 1].gain != gain || e[n - 1].hcg == down)
+		ret = -EIO;
+	free(e);
+
+	return ret;
+}
+
+static struct v4l2_rect roi_bounds;
+
+/* A 1280x720 window in the middle of the array */
+static int roi_setup(struct host_sensor *s)
+{
+	struct v4l2_subdev_selection sel = {
+		.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+		.target = V4L2_SEL_TGT_CROP_BOUNDS,
+	};
+	struct v4l2_rect r;
+	int ret;
+
+	ret = s->sd->ops->pad->get_selection(s->sd, NULL, &sel);
+	if (ret)
+		return ret;
+	roi_bounds = sel.r;
+
+	r.width = 1280;
+	r.height = 720;
+	r.left = roi_bounds.left + (roi_bounds.width - r.width) / 2;
+	r.top = roi_bounds.top + (roi_bounds.height - r.height) / 2;
+
+	return host_sensor_set_crop(s, &r);
+}
+
+/* Move the window while streaming, check the bus and the history */
+static int bench_roi_pan(struct host_sensor *s, unsigned long i)
+{
+	struct host_history_entry *e;
+	struct v4l2_rect r = {
+		.width = 1280,
+		.height = 720,
+	};
+	u32 hst, vst;
+	int ret, n;
+
+	r.left = roi_bounds.left + (i * 68) % (roi_bounds.width - r.width);
+	r.top = roi_bounds.top + (i * 36) % (roi_bounds.height - r.height);
+	ret = host_sensor_set_crop(s, &r);
+	if (ret)
+		return ret;
+
+	mutex_lock(&s->bus.adap.bus_lock);
+	hst = fake_i2c_peek(&s->bus, HOST_REG_PIX_HST, 2);
+	vst = fake_i2c_peek(&s->bus, HOST_REG_PIX_VST, 2);
+	mutex_unlock(&s->bus.adap.bus_lock);
+	if (hst != r.left - roi_bounds.left || vst != r.top - roi_bounds.top ||
+	    hst % 4 || vst % 4)
+		return -EIO;
+
+	n = host_sensor_history(s, &e);
+	if (n < 0)
+		return n;
+	if (e[n - 1].roi_left != hst || e[n - 1].roi_top != vst)
+		ret = -EIO;
+	free(e);
+
+	return ret;
+}
+
+/* One full resolution frame out of the binned stream, and back */
+static int bench_snapshot(struct host_sensor *s, unsigned long i)
+{
+	unsigned long events = s->sd->host_src_change_events;
+	s64 val;
+	int ret;
+
+	ret = host_sensor_s_ctrl(s, HOST_CID_SNAPSHOT, 1);
+	if (ret)
+		return ret;
+	if (addmode(s) != 0)
+		return -EIO;
+
+	do {
+		usleep(1000);
+		ret = host_sensor_g_ctrl(s, HOST_CID_SNAPSHOT, &val);
+	} while (!ret && val);
+
+	if (!ret && (addmode(s) != 1 || s->sd->host_src_change_events != events + 2))
+		ret = -EIO;
+
+	return ret;
+}
+
+/*
+ * System sleep in the middle of a snapshot and a ramp. Both end at suspend,
+ * nothing is sent to the powered down sensor while their frames would have
+ * passed, and resume restarts the binned stream.
+ */
+static int bench_system_sleep(struct host_sensor *s, unsigned long i)
+{
+	unsigned long xfers;
+	s64 snapshot, ramp;
+	int ret;
+
+	ret = host_sensor_s_ctrl(s, HOST_CID_SNAPSHOT, 2);
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_RAMP_EXPOSURE, i & 1 ? 200 : 1800);
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_RAMP_GAIN, i & 1 ? 10 : 120);
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_RAMP_FRAMES, 2 * HOST_RAMP_FRAMES);
+	ret = ret ?: host_sensor_suspend(s);
+	if (ret)
+		return ret;
+
+	mutex_lock(&s->bus.adap.bus_lock);
+	xfers = s->bus.xfers;
+	mutex_unlock(&s->bus.adap.bus_lock);
+
+	usleep(100000);
+
+	mutex_lock(&s->bus.adap.bus_lock);
+	if (s->bus.xfers != xfers)
+		ret = -EIO;
+	mutex_unlock(&s->bus.adap.bus_lock);
+
+	ret = ret ?: host_sensor_g_ctrl(s, HOST_CID_SNAPSHOT, &snapshot);
+	ret = ret ?: host_sensor_g_ctrl(s, HOST_CID_RAMP_FRAMES, &ramp);
+	if (!ret && (snapshot || ramp))
+		ret = -EIO;
+	ret = ret ?: host_sensor_resume(s);
+	if (!ret && (mode_select(s) != 0 || addmode(s) != 1))
+		ret = -EIO;
+
+	return ret;
+}
+
+/* Slot 0: binned, LCG, short exposure. Slot 1: full resolution, HCG, long */
+static const struct {
+	u32 width, height;
+	s64 hcg, vblank, exposure, gain;
+} presets[] = {
+	{ 1928, 1090, 0, 1160, 1000, 20 },
+	{ 3856, 2180, 1, 2000, 2000, 120 },
+};
+
+static int preset_setup(struct host_sensor *s)
+{
+	unsigned int p;
+	int ret = 0;
+
+	for (p = 0; p < ARRAY_SIZE(presets) && !ret; p++) {
+		ret = host_sensor_set_fmt(s, presets[p].width, presets[p].height);
+		ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_HCG, presets[p].hcg);
+		ret = ret ?: host_sensor_s_ctrl(s, V4L2_CID_VBLANK, presets[p].vblank);
+		ret = ret ?: host_sensor_s_ctrl(s, V4L2_CID_EXPOSURE, presets[p].exposure);
+		ret = ret ?: host_sensor_s_ctrl(s, V4L2_CID_ANALOGUE_GAIN, presets[p].gain);
+		ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_PRESET_SLOT, p);
+		ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_PRESET_SAVE, 1);
+	}
+
+	/* Back to the first one powered down, stream on starts from it */
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_PRESET_SLOT, 0);
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_PRESET_APPLY, 1);
+
+	return ret;
+}
+
+/*
+ * Switch between the presets while streaming. Each switch is one register
+ * hold around the registers that differ, one burst per run of addresses,
+ * at most ADDMODE, VMAX, HMAX, FDG, SHR and gain here. Applying the
+ * preset the sensor already runs writes nothing. The controls, the bus and the
+ * history must all end up on the preset.
+ */
+static int bench_preset(struct host_sensor *s, unsigned long i)
+{
+	unsigned int p = (i + 1) & 1;
+	unsigned long events = s->sd->host_src_change_events;
+	unsigned long xfers;
+	struct host_history_entry *e;
+	u32 hold, vmax;
+	s64 val;
+	int ret, n;
+
+	ret = host_sensor_s_ctrl(s, HOST_CID_PRESET_SLOT, p);
+	xfers = s->bus.xfers;
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_PRESET_APPLY, 1);
+	if (!ret && s->bus.xfers - xfers > 2 + 6)
+		ret = -EIO;
+	xfers = s->bus.xfers;
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_PRESET_APPLY, 1);
+	if (!ret && s->bus.xfers != xfers)
+		ret = -EIO;
+	if (ret)
+		return ret;
+
+	ret = host_sensor_g_ctrl(s, V4L2_CID_EXPOSURE, &val);
+	if (!ret && val != presets[p].exposure)
+		ret = -EIO;
+	ret = ret ?: host_sensor_g_ctrl(s, V4L2_CID_ANALOGUE_GAIN, &val);
+	if (!ret && val != presets[p].gain)
+		ret = -EIO;
+	if (ret)
+		return ret;
+	if (s->sd->host_src_change_events != events + 1 ||
+	    addmode(s) != (presets[p].height == 1090))
+		return -EIO;
+
+	mutex_lock(&s->bus.adap.bus_lock);
+	hold = fake_i2c_peek(&s->bus, HOST_REG_HOLD, 1);
+	vmax = fake_i2c_peek(&s->bus, HOST_REG_VMAX, 3);
+	mutex_unlock(&s->bus.adap.bus_lock);
+	if (hold || vmax != presets[p].height + presets[p].vblank)
+		return -EIO;
+
+	n = host_sensor_history(s, &e);
+	if (n < 0)
+		return n;
+	if (e[n - 1].vmax != vmax || e[n - 1].gain != presets[p].gain ||
+	    e[n - 1].hcg != presets[p].hcg)
+		ret = -EIO;
+	free(e);
+
+	return ret;
+}
+
+/* link_freqs[] indexes and DATARATE_SEL values of 891 and 1188 MHz */
+#define HOST_LINK_891		5
+#define HOST_LINK_1188		7
+#define HOST_DATARATE_891	0x02
+#define HOST_DATARATE_1188	0x00
+
+/* Stream once, then report what DATARATE_SEL and TPG_EN were set to */
+static int qualify_stream(struct host_sensor *s, u32 *datarate, u32 *tpg)
+{
+	int ret = host_sensor_s_stream(s, 1);
+
+	if (ret)
+		return ret;
+
+	mutex_lock(&s->bus.adap.bus_lock);
+	*datarate = fake_i2c_peek(&s->bus, HOST_REG_DATARATE_SEL, 1);
+	*tpg = fake_i2c_peek(&s->bus, HOST_REG_TPG_EN, 1);
+	mutex_unlock(&s->bus.adap.bus_lock);
+
+	return host_sensor_s_stream(s, 0);
+}
+
+/*
+ * DT runs the link at 1188 MHz and lists 891 and 594 MHz as well. The
+ * qualification streams the test pattern at 1188 MHz, which fails, then
+ * at 891 MHz, which passes. The link then runs 891 MHz without the
+ * pattern, and so does every probe after that, through max_link_freq.
+ */
+static int bench_link_qualify(struct host_sensor *s, unsigned long i)
+{
+	struct host_sensor_cfg qcfg = cfg;
+	u32 datarate, tpg;
+	s64 link;
+	int ret;
+
+	qcfg.link_freq = 1188000000;
+	qcfg.alt_link_freqs[0] = 891000000;
+	qcfg.alt_link_freqs[1] = 594000000;
+	ret = host_sensor_probe(s, &qcfg);
+	if (ret)
+		return ret;
+
+	/* A fixed link build has nothing to qualify */
+	if (!v4l2_ctrl_find(s->sd->ctrl_handler, HOST_CID_LINK_QUALIFY)) {
+		host_sensor_remove(s);
+		return 0;
+	}
+
+	ret = host_sensor_g_ctrl(s, V4L2_CID_LINK_FREQ, &link);
+	if (!ret && link != (i ? HOST_LINK_891 : HOST_LINK_1188))
+		ret = -EIO;
+
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_LINK_QUALIFY, 1);
+	/* Nothing streamed at the rate yet */
+	if (!ret && host_sensor_s_ctrl(s, HOST_CID_LINK_TEST_PASS, 1) != -EINVAL)
+		ret = -EIO;
+
+	ret = ret ?: qualify_stream(s, &datarate, &tpg);
+	if (!ret && (datarate != HOST_DATARATE_1188 || !tpg))
+		ret = -EIO;
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_LINK_TEST_FAIL, 1);
+
+	ret = ret ?: qualify_stream(s, &datarate, &tpg);
+	if (!ret && (datarate != HOST_DATARATE_891 || !tpg))
+		ret = -EIO;
+	ret = ret ?: host_sensor_s_ctrl(s, HOST_CID_LINK_TEST_PASS, 1);
+
+	ret = ret ?: host_sensor_g_ctrl(s, HOST_CID_LINK_QUALIFY, &link);
+	if (!ret && link)
+		ret = -EIO;
+	ret = ret ?: host_sensor_g_ctrl(s, V4L2_CID_LINK_FREQ, &link);
+	if (!ret && link != HOST_LINK_891)
+		ret = -EIO;
+	ret = ret ?: qualify_stream(s, &datarate, &tpg);
+	if (!ret && (datarate != HOST_DATARATE_891 || tpg))
+		ret = -EIO;
+
+	host_sensor_remove(s);
+
+	return ret;
+}
+
+static const struct bench benches[] = {
+	{ "probe",		bench_probe,			false },
+	{ "set_fmt",		bench_set_fmt,			true },
+	{ "set_ctrl",		bench_set_ctrl,			true },
+	{ "set_ctrl_streaming",	bench_set_ctrl_streaming,	true },
+	{ "ctrl_events",	bench_ctrl_events,		true },
+	{ "stream",		bench_stream,			true },
+	{ "history",		bench_history,			true },
+	{ "snapshot",		bench_snapshot,			true,	20 },
+	{ "roi_pan",		bench_roi_pan,			true,	0,	roi_setup },
+	{ "ramp",		bench_ramp,			true,	20 },
+	{ "stop",		bench_stop,			true,	60,	stop_setup },
+	{ "shared_xclr",	bench_shared_xclr,		false },
+	{ "preset",		bench_preset,			true,	0,	preset_setup },
+	{ "link_qualify",	bench_link_qualify,		false },
+	{ "system_sleep",	bench_system_sleep,		true,	10 },
+};
+
+static int run_bench(const struct bench *b, unsigned long iters)
+{
+	struct host_sensor *s = calloc(1, sizeof(*s));
+	bool streaming = b->run == bench_set_ctrl_streaming || b->run == bench_history ||
+			 b->run == bench_snapshot || b->run == bench_roi_pan ||
+			 b->run == bench_ramp || b->run == bench_preset ||
+			 b->run == bench_system_sleep;
+	/* The benches that change the frame size while streaming */
+	bool resize = b->run == bench_snapshot || b->run == bench_preset ||
+		      b->run == bench_system_sleep;
+	struct host_sensor_cfg c = cfg;
+	unsigned long i;
+	u64 t0, t1;
+	int ret = 0;
+
+	if (!s)
+		return -ENOMEM;
+
+	if (b->max_iters)
+		iters = min(iters, b->max_iters);
+
+	if (b->needs_probe) {
+		c.mid_stream_resize |= resize;
+		ret = host_sensor_probe(s, &c);
+		if (ret) {
+			fprintf(stderr, "%s: probe failed: %d\n", b->name, ret);
+			goto out;
+		}
+		if (b->setup)
+			ret = b->setup(s);
+		if (!ret && streaming)
+			ret = host_sensor_s_stream(s, 1);
+		if (ret)
+			goto out_remove;
+		fake_i2c_reset_stats(&s->bus);
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < iters && !ret; i++)
+		ret = b->run(s, i);
+	t1 = now_ns();
+
+	if (ret) {
+		fprintf(stderr, "%s: failed at iteration %lu: %d\n", b->name, i - 1, ret);
+	} else {
+		printf("%-20s %8lu ops %10.0f ns/op", b->name, iters,
+		       (double)(t1 - t0) / iters);
+		if (b->needs_probe)
+			printf(" %6.1f xfers/op %7.1f bytes/op",
+			       (double)s->bus.xfers / iters, (double)s->bus.bytes / iters);
+		printf("\n");
+	}
+
+	if (streaming)
+		host_sensor_s_stream(s, 0);
+out_remove:
+	if (b->needs_probe)
+		host_sensor_remove(s);
+out:
+	free(s);
+
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	unsigned int i;
+
+	fprintf(stderr,
+		"usage: %s [-n iterations] [-l lanes] [-f link_freq_hz] [-x xclk_hz]\n"
+		"          [-c] [-d] [-r] [-v] [-R] [bench...]\n"
+		"  -c  non-continuous clock lane\n"
+		"  -d  sony,link-downshift\n"
+		"  -r  sony,standby-retention\n"
+		"  -v  verbose driver logging\n"
+		"  -R  really sleep in usleep_range()/msleep()\n"
+		"benches:", prog);
+	for (i = 0; i < ARRAY_SIZE(benches); i++)
+		fprintf(stderr, " %s", benches[i].name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iters = 1000;
+	unsigned int i;
+	int opt, ret = 0;
+
+	cfg = host_default_cfg;
+
+	while ((opt = getopt(argc, argv, "n:l:f:x:cdrvRh")) != -1) {
+		switch (opt) {
+		case 'n':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			cfg.lanes = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			cfg.link_freq = strtoull(optarg, NULL, 0);
+			break;
+		case 'x':
+			cfg.xclk = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cfg.noncont_clk = true;
+			break;
+		case 'd':
+			cfg.link_downshift = true;
+			break;
+		case 'r':
+			cfg.standby_retention = true;
+			break;
+		case 'v':
+			host_log_level = HOST_LOG_DBG;
+			break;
+		case 'R':
+			host_real_sleep = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 2;
+		}
+	}
+
+	if (!iters) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(benches); i++) {
+		int j;
+
+		if (optind < argc) {
+			for (j = optind; j < argc; j++)
+				if (!strcmp(argv[j], benches[i].name))
+					break;
+			if (j == argc)
+				continue;
+		}
+
+		if (run_bench(&benches[i], iters))
+			ret = 1;
+	}
+
+	printf("virtual sleep: %llu us\n", (unsigned long long)host_slept_us());
+
+	return ret;
+}
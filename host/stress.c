@@ -0,0 +1,463 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * imx678 concurrency stress test for the host build.
+ *
+ * Control, format, stream and query threads hammer the subdev entry points
+ * of one instance at the same time, while a checker thread takes the control
+ * handler lock and verifies the state the driver leaves between operations:
+ * control values inside their ranges, streaming consistent with the grabbed
+ * controls and runtime PM, and VMAX on the bus matching VBLANK and the mode.
+ * The shim aborts on a lockdep_assert_held() violation; build with
+ * SANITIZE=thread to have TSan report data races, the host counterpart of
+ * running the target under KCSAN.
+ */
+#include <getopt.h>
+#include <time.h>
+
+#include "harness.h"
+
+enum stress_role {
+	ROLE_CTRL,
+	ROLE_FMT,
+	ROLE_STREAM,
+	ROLE_QUERY,
+	ROLE_CHECK,
+	NUM_ROLES,
+};
+
+static const char * const role_name[NUM_ROLES] = {
+	[ROLE_CTRL]	= "ctrl",
+	[ROLE_FMT]	= "fmt",
+	[ROLE_STREAM]	= "stream",
+	[ROLE_QUERY]	= "query",
+	[ROLE_CHECK]	= "check",
+};
+
+struct stress_thread {
+	pthread_t thread;
+	enum stress_role role;
+	unsigned int seed;
+	unsigned long ops;
+	unsigned long busy;
+};
+
+static struct host_sensor sensor;
+static struct host_sensor_cfg cfg;
+static unsigned long iters = 20000;
+static bool stop;
+static unsigned long failures;
+
+/* The minimum VMAX of every mode, VBLANK's minimum gives the mode height */
+#define STRESS_MIN_VMAX		2250
+
+/* Sensor registers the checker reads back */
+#define STRESS_REG_MODE_SELECT	0x3000
+#define STRESS_REG_ADDMODE	0x301B
+#define STRESS_REG_VMAX		0x3028
+
+/* Driver private control, nonzero while full resolution frames are streamed */
+#define STRESS_CID_SNAPSHOT	(V4L2_CID_USER_ASPEED_BASE + 10)
+
+/* Preset buttons, empty slots and windows are rejected with -EINVAL */
+#define STRESS_CID_PRESET_SAVE	(V4L2_CID_USER_ASPEED_BASE + 16)
+#define STRESS_CID_PRESET_APPLY	(V4L2_CID_USER_ASPEED_BASE + 17)
+
+/* Link test results, rejected with -EINVAL unless a qualified rate streamed */
+#define STRESS_CID_LINK_TEST_PASS	(V4L2_CID_USER_ASPEED_BASE + 19)
+#define STRESS_CID_LINK_TEST_FAIL	(V4L2_CID_USER_ASPEED_BASE + 20)
+
+#define stress_fail(...) do {						\
+	__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);		\
+	fprintf(stderr, "FAIL: " __VA_ARGS__);				\
+} while (0)
+
+static bool stopped(void)
+{
+	return __atomic_load_n(&stop, __ATOMIC_RELAXED);
+}
+
+static void stress_ctrl(struct stress_thread *t)
+{
+	struct v4l2_ctrl_handler *hdl = sensor.sd->ctrl_handler;
+	struct v4l2_ctrl *ctrl;
+	struct v4l2_query_ext_ctrl qc;
+	s64 range, val;
+	int ret;
+
+	/* The control array is fixed after probe */
+	ctrl = hdl->ctrls[rand_r(&t->seed) % hdl->nr_of_ctrls];
+	if (host_ioctl_queryctrl(hdl, ctrl->id, &qc))
+		return;
+
+	range = qc.maximum - qc.minimum;
+	val = qc.minimum + (range > 0 ? (s64)rand_r(&t->seed) % (range + 1) : 0);
+	/* Occasionally go out of range to exercise clamping and rejection */
+	if (!(rand_r(&t->seed) % 16))
+		val = qc.maximum + 1;
+
+	ret = host_ioctl_s_ctrl(hdl, qc.id, val);
+	switch (ret) {
+	case 0:
+		break;
+	case -EBUSY:
+		t->busy++;
+		break;
+	case -EACCES:
+		if (!(qc.flags & V4L2_CTRL_FLAG_READ_ONLY))
+			stress_fail("%s: -EACCES on writable control\n", ctrl->name);
+		break;
+	case -ERANGE:
+	case -EINVAL:
+		/* There is no snapshot to take in the full resolution mode */
+		if (qc.id == STRESS_CID_SNAPSHOT && ret == -EINVAL)
+			break;
+		if ((qc.id == STRESS_CID_PRESET_SAVE || qc.id == STRESS_CID_PRESET_APPLY) &&
+		    ret == -EINVAL)
+			break;
+		if ((qc.id == STRESS_CID_LINK_TEST_PASS || qc.id == STRESS_CID_LINK_TEST_FAIL) &&
+		    ret == -EINVAL)
+			break;
+		if (qc.type != V4L2_CTRL_TYPE_MENU &&
+		    qc.type != V4L2_CTRL_TYPE_INTEGER_MENU)
+			stress_fail("%s: %d on a non-menu control\n", ctrl->name, ret);
+		break;
+	default:
+		stress_fail("%s = %lld: %d\n", ctrl->name, (long long)val, ret);
+		break;
+	}
+}
+
+static void stress_fmt(struct stress_thread *t)
+{
+	static const u32 sizes[][2] = { { 1928, 1090 }, { 3856, 2180 } };
+	const u32 *size = sizes[rand_r(&t->seed) % ARRAY_SIZE(sizes)];
+	struct v4l2_subdev_state state = { };
+	struct v4l2_subdev_fh fh = { .state = &state };
+	struct v4l2_subdev_format fmt = {
+		.pad = 0,
+		.format = {
+			.width = size[0],
+			.height = size[1],
+			.code = MEDIA_BUS_FMT_SRGGB12_1X12,
+		},
+	};
+	int ret;
+
+	switch (rand_r(&t->seed) % 4) {
+	case 0:
+		/* A new file handle initialises its try state */
+		ret = sensor.sd->internal_ops->open(sensor.sd, &fh);
+		if (!ret) {
+			fmt.which = V4L2_SUBDEV_FORMAT_TRY;
+			ret = sensor.sd->ops->pad->set_fmt(sensor.sd, &state, &fmt);
+		}
+		break;
+	case 1:
+		fmt.which = V4L2_SUBDEV_FORMAT_ACTIVE;
+		ret = sensor.sd->ops->pad->get_fmt(sensor.sd, NULL, &fmt);
+		break;
+	default:
+		ret = host_sensor_set_fmt(&sensor, size[0], size[1]);
+		/* Mode changes are refused while streaming */
+		if (ret == -EBUSY) {
+			t->busy++;
+			ret = 0;
+		}
+		break;
+	}
+
+	if (ret)
+		stress_fail("format op: %d\n", ret);
+}
+
+/* Runs with the control handler lock, which is the driver's mutex, held */
+static void stress_check_locked(void)
+{
+	struct v4l2_ctrl_handler *hdl = sensor.sd->ctrl_handler;
+	struct device *dev = &sensor.client.dev;
+	struct v4l2_ctrl *vblank = NULL, *hflip = NULL, *snapshot = NULL;
+	unsigned int i;
+	bool streaming, stopping;
+
+	for (i = 0; i < hdl->nr_of_ctrls; i++) {
+		struct v4l2_ctrl *ctrl = hdl->ctrls[i];
+		s64 cur = ctrl->type == V4L2_CTRL_TYPE_INTEGER64 ?
+			  ctrl->cur.val64 : ctrl->cur.val;
+
+		if (cur < ctrl->minimum || cur > ctrl->maximum)
+			stress_fail("%s = %lld outside [%lld, %lld]\n", ctrl->name,
+				    (long long)cur, (long long)ctrl->minimum,
+				    (long long)ctrl->maximum);
+		if (ctrl->val != ctrl->cur.val)
+			stress_fail("%s new value %d left behind\n", ctrl->name, ctrl->val);
+
+		if (ctrl->id == V4L2_CID_VBLANK)
+			vblank = ctrl;
+		else if (ctrl->id == V4L2_CID_HFLIP)
+			hflip = ctrl;
+		else if (ctrl->id == STRESS_CID_SNAPSHOT)
+			snapshot = ctrl;
+	}
+
+	streaming = hflip->flags & V4L2_CTRL_FLAG_GRABBED;
+
+	/*
+	 * A stop at frame end leaves the sensor streaming, with its runtime
+	 * PM reference, until the frame is out
+	 */
+	mutex_lock(&sensor.bus.adap.bus_lock);
+	stopping = !streaming && !fake_i2c_peek(&sensor.bus, STRESS_REG_MODE_SELECT, 1);
+	mutex_unlock(&sensor.bus.adap.bus_lock);
+
+	mutex_lock(&dev->pm_lock);
+	if (streaming && (!dev->pm_active || dev->pm_usage < 1))
+		stress_fail("streaming but runtime suspended (usage %d)\n", dev->pm_usage);
+	if (!streaming && (dev->pm_active || dev->pm_usage) && !(stopping && dev->pm_usage == 1))
+		stress_fail("idle but runtime active (usage %d)\n", dev->pm_usage);
+	mutex_unlock(&dev->pm_lock);
+
+	if (streaming) {
+		u32 height = STRESS_MIN_VMAX - vblank->minimum;
+		u32 sensor_height, vmax;
+
+		mutex_lock(&sensor.bus.adap.bus_lock);
+		sensor_height = fake_i2c_peek(&sensor.bus, STRESS_REG_ADDMODE, 1) ? 1090 : 2180;
+		vmax = fake_i2c_peek(&sensor.bus, STRESS_REG_VMAX, 3);
+		mutex_unlock(&sensor.bus.adap.bus_lock);
+
+		/*
+		 * The mode the controls are set up for is the one streaming,
+		 * except for the full resolution frames of a snapshot
+		 */
+		if (height != sensor_height && !(snapshot->cur.val && sensor_height == 2180))
+			stress_fail("controls for %u lines, sensor streams %u\n",
+				    height, sensor_height);
+		if (!snapshot->cur.val && height != sensor_height)
+			stress_fail("snapshot over, sensor still streams %u lines\n",
+				    sensor_height);
+
+		/* A downshifted link rescales VMAX, only the direct mapping is checked */
+		if (!cfg.link_downshift && vmax != ((height + vblank->cur.val) & ~1u))
+			stress_fail("VMAX %u, expected %u + %d\n", vmax, height,
+				    vblank->cur.val);
+	}
+}
+
+static void stress_check(struct stress_thread *t)
+{
+	struct v4l2_ctrl_handler *hdl = sensor.sd->ctrl_handler;
+
+	mutex_lock(hdl->lock);
+	stress_check_locked();
+	mutex_unlock(hdl->lock);
+}
+
+static void stress_stream(struct stress_thread *t)
+{
+	unsigned int spin = rand_r(&t->seed) % 1000;
+	int ret;
+
+	ret = host_sensor_s_stream(&sensor, 1);
+	/* Another stream thread is waiting for the frame end to stop */
+	if (ret == -EBUSY) {
+		t->busy++;
+		return;
+	}
+	if (ret) {
+		stress_fail("stream on: %d\n", ret);
+		return;
+	}
+
+	while (spin--)
+		__asm__ __volatile__("" ::: "memory");
+
+	/*
+	 * Whatever ran while streaming has to have left a consistent state,
+	 * the checker thread alone rarely lands in this window on few CPUs.
+	 */
+	stress_check(t);
+
+	ret = host_sensor_s_stream(&sensor, 0);
+	if (ret)
+		stress_fail("stream off: %d\n", ret);
+}
+
+static void stress_query(struct stress_thread *t)
+{
+	const struct v4l2_subdev_pad_ops *pad = sensor.sd->ops->pad;
+	struct v4l2_mbus_frame_desc fd;
+	struct v4l2_mbus_config mbus;
+	struct v4l2_subdev_selection sel = {
+		.which = V4L2_SUBDEV_FORMAT_ACTIVE,
+		.target = V4L2_SEL_TGT_CROP,
+	};
+	int ret = 0;
+
+	struct host_history_entry *e;
+
+	switch (rand_r(&t->seed) % 4) {
+	case 0:
+		ret = pad->get_frame_desc(sensor.sd, 0, &fd);
+		if (!ret && fd.num_entries < 1)
+			stress_fail("empty frame descriptor\n");
+		break;
+	case 1:
+		ret = pad->get_mbus_config(sensor.sd, 0, &mbus);
+		if (!ret && mbus.bus.mipi_csi2.num_data_lanes != 2 &&
+		    mbus.bus.mipi_csi2.num_data_lanes != 4)
+			stress_fail("%u data lanes\n", mbus.bus.mipi_csi2.num_data_lanes);
+		break;
+	case 2:
+		ret = pad->get_selection(sensor.sd, NULL, &sel);
+		break;
+	case 3:
+		/* Lock-free reader racing the control and stream threads */
+		ret = host_sensor_history(&sensor, &e);
+		if (ret >= 0) {
+			free(e);
+			ret = 0;
+		}
+		break;
+	}
+
+	if (ret)
+		stress_fail("query op: %d\n", ret);
+}
+
+static void *stress_thread_fn(void *arg)
+{
+	struct stress_thread *t = arg;
+
+	while (!stopped() && (t->role == ROLE_CHECK || t->ops < iters)) {
+		switch (t->role) {
+		case ROLE_CTRL:
+			stress_ctrl(t);
+			break;
+		case ROLE_FMT:
+			stress_fmt(t);
+			break;
+		case ROLE_STREAM:
+			stress_stream(t);
+			break;
+		case ROLE_QUERY:
+			stress_query(t);
+			break;
+		case ROLE_CHECK:
+			stress_check(t);
+			break;
+		default:
+			break;
+		}
+		t->ops++;
+	}
+
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n iterations] [-t threads per role] [-s seed]\n"
+		"          [-l lanes] [-f link_freq_hz] [-d] [-r] [-v]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nthreads = 2, seed = time(NULL);
+	struct stress_thread *threads;
+	struct device *dev = &sensor.client.dev;
+	unsigned int i, n;
+	int opt, ret;
+
+	cfg = host_default_cfg;
+	/* Snapshots and presets in another mode take part */
+	cfg.mid_stream_resize = true;
+
+	while ((opt = getopt(argc, argv, "n:t:s:l:f:drvh")) != -1) {
+		switch (opt) {
+		case 'n':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nthreads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			cfg.lanes = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			cfg.link_freq = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			cfg.link_downshift = true;
+			break;
+		case 'r':
+			cfg.standby_retention = true;
+			break;
+		case 'v':
+			host_log_level = HOST_LOG_DBG;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 2;
+		}
+	}
+
+	if (!nthreads) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	ret = host_sensor_probe(&sensor, &cfg);
+	if (ret) {
+		fprintf(stderr, "probe failed: %d\n", ret);
+		return 1;
+	}
+
+	/* One checker, nthreads of every other role */
+	n = (NUM_ROLES - 1) * nthreads + 1;
+	threads = calloc(n, sizeof(*threads));
+	if (!threads)
+		return 1;
+
+	printf("seed %u, %u threads, %lu iterations per thread\n", seed, n, iters);
+
+	for (i = 0; i < n; i++) {
+		threads[i].role = i == n - 1 ? ROLE_CHECK : i % (NUM_ROLES - 1);
+		threads[i].seed = seed + i;
+		pthread_create(&threads[i].thread, NULL, stress_thread_fn, &threads[i]);
+	}
+
+	for (i = 0; i < n - 1; i++)
+		pthread_join(threads[i].thread, NULL);
+	__atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+	pthread_join(threads[n - 1].thread, NULL);
+
+	for (i = 0; i < n; i++)
+		printf("%-6s #%u %8lu ops %8lu busy\n", role_name[threads[i].role],
+		       i, threads[i].ops, threads[i].busy);
+
+	/* Everything idle again: the final state and the power balance */
+	host_sensor_wait_idle(&sensor, 2000);
+	stress_check(NULL);
+	if (dev->pm_usage || dev->pm_active)
+		stress_fail("runtime PM unbalanced: usage %d active %d\n",
+			    dev->pm_usage, dev->pm_active);
+	if (dev->clk->enable_count)
+		stress_fail("xclk left enabled (%d)\n", dev->clk->enable_count);
+	if (!cfg.standby_retention && dev->regulator->enable_count)
+		stress_fail("supplies left enabled (%d)\n", dev->regulator->enable_count);
+
+	host_sensor_remove(&sensor);
+	free(threads);
+
+	if (failures) {
+		printf("%lu failures\n", failures);
+		return 1;
+	}
+	printf("pass\n");
+
+	return 0;
+}
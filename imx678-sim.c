@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Simulated Sony imx678 instance, for testing the driver without hardware.
+ *
+ * Loading this module registers a loopback I2C adapter backed by a register
+ * file, an imx678 client on it described by software nodes (one CSI-2
+ * endpoint), a fixed xclk and supply for it, and a minimal bridge that
+ * binds the sensor and exposes it as /dev/v4l-subdevN behind /dev/mediaN.
+ * v4l2-compliance and control/format tests then run against the unmodified
+ * driver on any Linux machine:
+ *
+ *   insmod imx678.ko
+ *   insmod imx678-sim.ko lanes=4 link_freq=891000000
+ *   v4l2-compliance -u /dev/v4l-subdevN
+ */
+#include <dt-bindings/media/video-interfaces.h>
+#include <linux/unaligned.h>
+#include <linux/clk-provider.h>
+#include <linux/clkdev.h>
+#include <linux/i2c.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/property.h>
+#include <linux/regulator/fixed.h>
+#include <linux/regulator/machine.h>
+#include <media/media-device.h>
+#include <media/v4l2-async.h>
+#include <media/v4l2-device.h>
+
+#define IMX678_SIM_ADDR		0x1a
+#define IMX678_SIM_XCLK		24000000
+#define IMX678_SIM_NUM_REGS	0x10000
+
+static unsigned int lanes = 4;
+module_param(lanes, uint, 0444);
+MODULE_PARM_DESC(lanes, "CSI-2 data lanes, 2 or 4");
+
+static unsigned long link_freq = 891000000;
+module_param(link_freq, ulong, 0444);
+MODULE_PARM_DESC(link_freq, "CSI-2 link frequency in Hz, one the driver supports");
+
+static bool link_downshift;
+module_param(link_downshift, bool, 0444);
+MODULE_PARM_DESC(link_downshift, "Set sony,link-downshift on the sensor");
+
+static bool standby_retention;
+module_param(standby_retention, bool, 0444);
+MODULE_PARM_DESC(standby_retention, "Set sony,standby-retention on the sensor");
+
+static bool mid_stream_resize;
+module_param(mid_stream_resize, bool, 0444);
+MODULE_PARM_DESC(mid_stream_resize, "Set sony,mid-stream-resize on the sensor");
+
+enum {
+	SIM_NODE_SENSOR,
+	SIM_NODE_PORT,
+	SIM_NODE_ENDPOINT,
+	SIM_NUM_NODES,
+};
+
+struct imx678_sim {
+	struct platform_device *pdev;
+	struct media_device mdev;
+	struct v4l2_device v4l2_dev;
+	struct v4l2_async_notifier notifier;
+
+	struct i2c_adapter adap;
+	struct i2c_client *client;
+	char client_name[I2C_NAME_SIZE + 8];
+
+	struct clk_hw *xclk;
+	struct clk_lookup *xclk_lookup;
+
+	struct platform_device *supply;
+	struct regulator_consumer_supply consumers[3];
+	struct regulator_init_data supply_init;
+	struct fixed_voltage_config supply_cfg;
+
+	u32 data_lanes[4];
+	u64 link_freqs[1];
+	struct property_entry sensor_props[4];
+	struct property_entry ep_props[4];
+	struct software_node nodes[SIM_NUM_NODES];
+	const struct software_node *node_group[SIM_NUM_NODES + 1];
+
+	/* Register file, 16-bit addressed with auto increment like the sensor */
+	u8 regs[IMX678_SIM_NUM_REGS];
+};
+
+static struct imx678_sim *imx678_sim;
+
+static int imx678_sim_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	struct imx678_sim *sim = i2c_get_adapdata(adap);
+	u16 ptr = 0;
+	int i, j;
+
+	for (i = 0; i < num; i++) {
+		struct i2c_msg *msg = &msgs[i];
+
+		if (msg->addr != IMX678_SIM_ADDR)
+			return -ENXIO;
+
+		if (msg->flags & I2C_M_RD) {
+			for (j = 0; j < msg->len; j++)
+				msg->buf[j] = sim->regs[ptr++];
+			continue;
+		}
+
+		if (msg->len < 2)
+			return -EIO;
+
+		ptr = get_unaligned_be16(msg->buf);
+		for (j = 2; j < msg->len; j++)
+			sim->regs[ptr++] = msg->buf[j];
+	}
+
+	return num;
+}
+
+static u32 imx678_sim_functionality(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C;
+}
+
+static const struct i2c_algorithm imx678_sim_algo = {
+	.master_xfer = imx678_sim_xfer,
+	.functionality = imx678_sim_functionality,
+};
+
+static int imx678_sim_notify_complete(struct v4l2_async_notifier *notifier)
+{
+	struct imx678_sim *sim = container_of(notifier, struct imx678_sim, notifier);
+
+	return v4l2_device_register_subdev_nodes(&sim->v4l2_dev);
+}
+
+static const struct v4l2_async_notifier_operations imx678_sim_notify_ops = {
+	.complete = imx678_sim_notify_complete,
+};
+
+static void imx678_sim_init_nodes(struct imx678_sim *sim)
+{
+	struct software_node *nodes = sim->nodes;
+	unsigned int i, n = 0;
+
+	for (i = 0; i < lanes; i++)
+		sim->data_lanes[i] = i + 1;
+	sim->link_freqs[0] = link_freq;
+
+	if (link_downshift)
+		sim->sensor_props[n++] = PROPERTY_ENTRY_BOOL("sony,link-downshift");
+	if (standby_retention)
+		sim->sensor_props[n++] = PROPERTY_ENTRY_BOOL("sony,standby-retention");
+	if (mid_stream_resize)
+		sim->sensor_props[n++] = PROPERTY_ENTRY_BOOL("sony,mid-stream-resize");
+
+	sim->ep_props[0] = PROPERTY_ENTRY_U32("bus-type", MEDIA_BUS_TYPE_CSI2_DPHY);
+	sim->ep_props[1] = PROPERTY_ENTRY_U32_ARRAY_LEN("data-lanes", sim->data_lanes, lanes);
+	sim->ep_props[2] = PROPERTY_ENTRY_U64_ARRAY_LEN("link-frequencies", sim->link_freqs,
+							ARRAY_SIZE(sim->link_freqs));
+
+	nodes[SIM_NODE_SENSOR] = (struct software_node) {
+		.name = "imx678-sim",
+		.properties = sim->sensor_props,
+	};
+	nodes[SIM_NODE_PORT] = (struct software_node) {
+		.name = "port@0",
+		.parent = &nodes[SIM_NODE_SENSOR],
+	};
+	nodes[SIM_NODE_ENDPOINT] = (struct software_node) {
+		.name = "endpoint@0",
+		.parent = &nodes[SIM_NODE_PORT],
+		.properties = sim->ep_props,
+	};
+
+	for (i = 0; i < SIM_NUM_NODES; i++)
+		sim->node_group[i] = &nodes[i];
+}
+
+/* One fixed regulator feeds all three sensor supplies */
+static int imx678_sim_add_supply(struct imx678_sim *sim)
+{
+	static const char * const supply_names[] = { "VANA", "VDIG", "VDDL" };
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(supply_names); i++) {
+		sim->consumers[i].supply = supply_names[i];
+		sim->consumers[i].dev_name = sim->client_name;
+	}
+
+	sim->supply_init.consumer_supplies = sim->consumers;
+	sim->supply_init.num_consumer_supplies = ARRAY_SIZE(sim->consumers);
+
+	sim->supply_cfg.supply_name = "imx678-sim";
+	sim->supply_cfg.microvolts = 1800000;
+	sim->supply_cfg.init_data = &sim->supply_init;
+
+	sim->supply = platform_device_register_data(&sim->pdev->dev, "reg-fixed-voltage",
+						    PLATFORM_DEVID_AUTO, &sim->supply_cfg,
+						    sizeof(sim->supply_cfg));
+
+	return PTR_ERR_OR_ZERO(sim->supply);
+}
+
+static int __init imx678_sim_init(void)
+{
+	struct i2c_board_info info = {
+		I2C_BOARD_INFO("imx678", IMX678_SIM_ADDR),
+	};
+	struct v4l2_async_connection *asc;
+	struct imx678_sim *sim;
+	int ret;
+
+	if (lanes != 2 && lanes != 4)
+		return -EINVAL;
+
+	sim = kvzalloc(sizeof(*sim), GFP_KERNEL);
+	if (!sim)
+		return -ENOMEM;
+
+	imx678_sim_init_nodes(sim);
+
+	sim->pdev = platform_device_register_simple("imx678-sim", PLATFORM_DEVID_NONE, NULL, 0);
+	if (IS_ERR(sim->pdev)) {
+		ret = PTR_ERR(sim->pdev);
+		goto error_free;
+	}
+
+	sim->mdev.dev = &sim->pdev->dev;
+	strscpy(sim->mdev.model, "imx678-sim", sizeof(sim->mdev.model));
+	media_device_init(&sim->mdev);
+	sim->v4l2_dev.mdev = &sim->mdev;
+
+	ret = v4l2_device_register(&sim->pdev->dev, &sim->v4l2_dev);
+	if (ret)
+		goto error_media_cleanup;
+
+	ret = media_device_register(&sim->mdev);
+	if (ret)
+		goto error_v4l2_unregister;
+
+	ret = software_node_register_node_group(sim->node_group);
+	if (ret)
+		goto error_media_unregister;
+
+	sim->adap.owner = THIS_MODULE;
+	sim->adap.algo = &imx678_sim_algo;
+	sim->adap.dev.parent = &sim->pdev->dev;
+	strscpy(sim->adap.name, "imx678-sim", sizeof(sim->adap.name));
+	i2c_set_adapdata(&sim->adap, sim);
+
+	ret = i2c_add_adapter(&sim->adap);
+	if (ret)
+		goto error_nodes_unregister;
+
+	/* Name the client gets, for the clock and supply lookups */
+	snprintf(sim->client_name, sizeof(sim->client_name), "%d-%04x",
+		 i2c_adapter_id(&sim->adap), IMX678_SIM_ADDR);
+
+	sim->xclk = clk_hw_register_fixed_rate(NULL, "imx678-sim-xclk", NULL, 0,
+					       IMX678_SIM_XCLK);
+	if (IS_ERR(sim->xclk)) {
+		ret = PTR_ERR(sim->xclk);
+		goto error_del_adapter;
+	}
+
+	sim->xclk_lookup = clkdev_hw_create(sim->xclk, NULL, "%s", sim->client_name);
+	if (!sim->xclk_lookup) {
+		ret = -ENOMEM;
+		goto error_clk_unregister;
+	}
+
+	ret = imx678_sim_add_supply(sim);
+	if (ret)
+		goto error_clkdev_drop;
+
+	v4l2_async_nf_init(&sim->notifier, &sim->v4l2_dev);
+	sim->notifier.ops = &imx678_sim_notify_ops;
+
+	asc = v4l2_async_nf_add_fwnode(&sim->notifier,
+				       software_node_fwnode(&sim->nodes[SIM_NODE_SENSOR]),
+				       struct v4l2_async_connection);
+	if (IS_ERR(asc)) {
+		ret = PTR_ERR(asc);
+		goto error_nf_cleanup;
+	}
+
+	ret = v4l2_async_nf_register(&sim->notifier);
+	if (ret)
+		goto error_nf_cleanup;
+
+	info.swnode = &sim->nodes[SIM_NODE_SENSOR];
+	sim->client = i2c_new_client_device(&sim->adap, &info);
+	if (IS_ERR(sim->client)) {
+		ret = PTR_ERR(sim->client);
+		goto error_nf_unregister;
+	}
+
+	imx678_sim = sim;
+
+	return 0;
+
+error_nf_unregister:
+	v4l2_async_nf_unregister(&sim->notifier);
+error_nf_cleanup:
+	v4l2_async_nf_cleanup(&sim->notifier);
+	platform_device_unregister(sim->supply);
+error_clkdev_drop:
+	clkdev_drop(sim->xclk_lookup);
+error_clk_unregister:
+	clk_hw_unregister_fixed_rate(sim->xclk);
+error_del_adapter:
+	i2c_del_adapter(&sim->adap);
+error_nodes_unregister:
+	software_node_unregister_node_group(sim->node_group);
+error_media_unregister:
+	media_device_unregister(&sim->mdev);
+error_v4l2_unregister:
+	v4l2_device_unregister(&sim->v4l2_dev);
+error_media_cleanup:
+	media_device_cleanup(&sim->mdev);
+	platform_device_unregister(sim->pdev);
+error_free:
+	kvfree(sim);
+
+	return ret;
+}
+
+static void __exit imx678_sim_exit(void)
+{
+	struct imx678_sim *sim = imx678_sim;
+
+	i2c_unregister_device(sim->client);
+	v4l2_async_nf_unregister(&sim->notifier);
+	v4l2_async_nf_cleanup(&sim->notifier);
+	platform_device_unregister(sim->supply);
+	clkdev_drop(sim->xclk_lookup);
+	clk_hw_unregister_fixed_rate(sim->xclk);
+	i2c_del_adapter(&sim->adap);
+	software_node_unregister_node_group(sim->node_group);
+	media_device_unregister(&sim->mdev);
+	v4l2_device_unregister(&sim->v4l2_dev);
+	media_device_cleanup(&sim->mdev);
+	platform_device_unregister(sim->pdev);
+	kvfree(sim);
+}
+
+module_init(imx678_sim_init);
+module_exit(imx678_sim_exit);
+
+MODULE_DESCRIPTION("Simulated Sony imx678 instance for driver testing");
+MODULE_LICENSE("GPL");
+MODULE_SOFTDEP("pre: imx678");
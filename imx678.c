@@ -9,26 +9,47 @@
  */
 #include <linux/unaligned.h>
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
 #include <linux/i2c.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
 #include <linux/module.h>
 #include <linux/of_device.h>
 #include <linux/of_graph.h>
 #include <linux/pm_runtime.h>
+#include <linux/property.h>
 #include <linux/regulator/consumer.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+#include <media/mipi-csi2.h>
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-event.h>
 #include <media/v4l2-fwnode.h>
 #include <media/v4l2-mediabus.h>
+#include <media/v4l2-rect.h>
 
 // Support for rpi kernel pre git commit 314a685
 #ifndef MEDIA_BUS_FMT_SENSOR_DATA
 #define MEDIA_BUS_FMT_SENSOR_DATA       0x7002
 #endif
 
-#define V4L2_CID_IMX585_HCG_GAIN         (V4L2_CID_USER_ASPEED_BASE + 6)
+/* Same id the IMX585 driver uses for its HCG switch, kept for userspace */
+#define V4L2_CID_IMX678_HCG_GAIN         (V4L2_CID_USER_ASPEED_BASE + 6)
+#define V4L2_CID_IMX678_SNAPSHOT         (V4L2_CID_USER_ASPEED_BASE + 10)
+#define V4L2_CID_IMX678_RAMP_EXPOSURE    (V4L2_CID_USER_ASPEED_BASE + 11)
+#define V4L2_CID_IMX678_RAMP_GAIN        (V4L2_CID_USER_ASPEED_BASE + 12)
+#define V4L2_CID_IMX678_RAMP_FRAMES      (V4L2_CID_USER_ASPEED_BASE + 13)
+#define V4L2_CID_IMX678_STOP_MODE        (V4L2_CID_USER_ASPEED_BASE + 14)
+#define V4L2_CID_IMX678_PRESET_SLOT      (V4L2_CID_USER_ASPEED_BASE + 15)
+#define V4L2_CID_IMX678_PRESET_SAVE      (V4L2_CID_USER_ASPEED_BASE + 16)
+#define V4L2_CID_IMX678_PRESET_APPLY     (V4L2_CID_USER_ASPEED_BASE + 17)
+#define V4L2_CID_IMX678_LINK_QUALIFY     (V4L2_CID_USER_ASPEED_BASE + 18)
+#define V4L2_CID_IMX678_LINK_TEST_PASS   (V4L2_CID_USER_ASPEED_BASE + 19)
+#define V4L2_CID_IMX678_LINK_TEST_FAIL   (V4L2_CID_USER_ASPEED_BASE + 20)
 
 /*
  * Initialisation delay between XCLR low->high and the moment when the sensor
@@ -37,6 +58,10 @@
 #define IMX678_XCLR_MIN_DELAY_US    500000
 #define IMX678_XCLR_DELAY_RANGE_US  1000
 
+/* INCK restart while retaining registers in standby */
+#define IMX678_INCK_SETTLE_US       1000
+#define IMX678_INCK_SETTLE_RANGE_US 100
+
 /* Standby or streaming mode */
 #define IMX678_REG_MODE_SELECT          0x3000
 #define IMX678_MODE_STANDBY             0x01
@@ -64,6 +89,46 @@
 /* Lane Count */
 #define IMX678_LANEMODE                 0x3040
 
+/* MIPI D-PHY global timing, 2 byte registers in units of 1/link_freq */
+#define IMX678_REG_TCLKPOST             0x3446
+#define IMX678_REG_THSZERO              0x3448
+#define IMX678_REG_THSPREPARE           0x344A
+#define IMX678_REG_TCLKTRAIL            0x344C
+#define IMX678_REG_THSTRAIL             0x344E
+#define IMX678_REG_TCLKZERO             0x3450
+#define IMX678_REG_TCLKPREPARE          0x3452
+#define IMX678_REG_TLPX                 0x3454
+
+/* Test pattern generator, streamed while qualifying link rates */
+#define IMX678_REG_TPG_EN_DUOUT         0x30E0
+#define IMX678_REG_TPG_PATSEL_DUOUT     0x30E2
+#define IMX678_REG_TPG_COLORWIDTH       0x30E4
+/* 555h and AAAh alternating, every data bit toggles from pixel to pixel */
+#define IMX678_TPG_PATSEL_TOGGLE        0x04
+
+/*
+ * Window cropping of the all-pixel readout. Start and size are relative to
+ * the effective pixel array; starts keep the Bayer order and the width
+ * keeps whole RAW12 packets.
+ */
+#define IMX678_REG_WINMODE              0x3018
+#define IMX678_WINMODE_ALL              0x00
+#define IMX678_WINMODE_CROP             0x04
+#define IMX678_REG_PIX_HST              0x303C
+#define IMX678_REG_PIX_HWIDTH           0x303E
+#define IMX678_REG_PIX_VST              0x3044
+#define IMX678_REG_PIX_VWIDTH           0x3046
+#define IMX678_ROI_POS_ALIGN            4
+#define IMX678_ROI_WIDTH_ALIGN          16
+#define IMX678_ROI_HEIGHT_ALIGN         4
+#define IMX678_ROI_MIN_WIDTH            320
+#define IMX678_ROI_MIN_HEIGHT           240
+/* Full resolution mode registers plus WINMODE and the four window registers */
+#define IMX678_ROI_REGS_MAX             16
+
+/* CSI-2 virtual channel of all output packets, not configurable */
+#define IMX678_VC                       0
+
 /* VMAX internal VBLANK*/
 #define IMX678_REG_VMAX                 0x3028
 #define IMX678_VMAX_MAX                 0xfffff
@@ -106,12 +171,37 @@
 #define IMX678_FLIP_WINMODEH            0x3020
 #define IMX678_FLIP_WINMODEV            0x3021
 
+/* Longest run of consecutive registers sent as one I2C write */
+#define IMX678_BURST_MAX_LEN            32
+
 /* Embedded metadata stream structure */
 #define IMX678_EMBEDDED_LINE_WIDTH      16384
 #define IMX678_NUM_EMBEDDED_LINES       1
 
 #define IMX678_PIXEL_RATE               74250000
 
+/* Records kept of applied parameters, power of two */
+#define IMX678_HISTORY_LEN              256
+
+/* Full resolution frames one snapshot can take */
+#define IMX678_SNAPSHOT_MAX             16
+
+/* Frames one exposure/gain ramp can span */
+#define IMX678_RAMP_MAX                 255
+
+/*
+ * Stream off at frame end: lines after the active ones still read out
+ * (optical black, embedded data), and the longest a blocking and a
+ * deferred stop wait
+ */
+#define IMX678_STOP_MARGIN_LINES        32
+#define IMX678_STOP_WAIT_MAX_US         100000
+#define IMX678_STOP_DEFER_MAX_US        1000000
+
+/* Configuration presets, and the register writes of one switch */
+#define IMX678_PRESET_NUM               4
+#define IMX678_PRESET_REGS_MAX          32
+
 enum pad_types {
 	IMAGE_PAD,
 	METADATA_PAD,
@@ -161,7 +251,7 @@ static const u64 link_freqs[] = {
 };
 
 //min HMAX for 4-lane 4K full res mode, x2 for 2-lane, /2 for FHD
-static const u16 HMAX_table_4lane_4K[] = {
+static const u16 imx678_hmax_4lane[] = {
 	[IMX678_LINK_FREQ_297MHZ] = 1584,
 	[IMX678_LINK_FREQ_360MHZ] = 1320,
 	[IMX678_LINK_FREQ_445MHZ] = 1100,
@@ -172,6 +262,20 @@ static const u16 HMAX_table_4lane_4K[] = {
 	[IMX678_LINK_FREQ_1188MHZ] = 396,
 };
 
+struct imx678_dphy_timing {
+	u16 tclkpost;
+	u16 thszero;
+	u16 thsprepare;
+	u16 tclktrail;
+	u16 thstrail;
+	u16 tclkzero;
+	u16 tclkprepare;
+	u16 tlpx;
+};
+
+#define IMX678_DPHY_TIMING_NUM \
+	(sizeof(struct imx678_dphy_timing) / sizeof(u16))
+
 struct imx678_inck_cfg {
 	u32 xclk_hz;   /* platform clock rate  */
 	u8  inck_sel;  /* value for reg        */
@@ -194,6 +298,83 @@ static const char * const sync_mode_menu[] = {
 	"Follower Mode",
 };
 
+enum imx678_stop_mode {
+	IMX678_STOP_IMMEDIATE,
+	IMX678_STOP_FRAME_END,
+	IMX678_STOP_FRAME_END_DEFERRED,
+};
+
+static const char * const stop_mode_menu[] = {
+	[IMX678_STOP_IMMEDIATE]          = "Immediate",
+	[IMX678_STOP_FRAME_END]          = "Wait for Frame End",
+	[IMX678_STOP_FRAME_END_DEFERRED] = "At Frame End, Non-blocking",
+};
+
+/*
+ * Set by link qualification, caps the DT link of the sensors probed after.
+ * One value for the module, not per sensor: the last pass wins, and only a
+ * probe applies it. Read only in sysfs, so it is set at load time or by a
+ * qualification, never under a sensor that is already probed.
+ */
+static unsigned long max_link_freq;
+module_param(max_link_freq, ulong, 0444);
+MODULE_PARM_DESC(max_link_freq, "Highest link frequency in Hz to probe with, 0 for no limit");
+
+/* Links a failed qualification was already warned about, for all sensors */
+static unsigned long imx678_qual_warned;
+
+/*
+ * Fixed board configuration. Products with a single lane count, link
+ * frequency, INCK and sync mode can build the driver with any of
+ * IMX678_FIXED_LANES, IMX678_FIXED_LINK_FREQ (Hz), IMX678_FIXED_XCLK (Hz)
+ * and IMX678_FIXED_SYNC_MODE defined (see Makefile). The value is then a
+ * constant: the DT lookup and table search for it are compiled out, DT
+ * values that disagree are reported and ignored, and a fixed link drops
+ * link downshift. Without them everything comes from DT as before.
+ */
+#ifdef IMX678_FIXED_LANES
+static_assert(IMX678_FIXED_LANES == 2 || IMX678_FIXED_LANES == 4,
+	      "IMX678_FIXED_LANES must be 2 or 4");
+#endif
+
+#ifdef IMX678_FIXED_LINK_FREQ
+#define IMX678_FIXED_LINK_IDX						\
+	((IMX678_FIXED_LINK_FREQ) ==  297000000 ? IMX678_LINK_FREQ_297MHZ :	\
+	 (IMX678_FIXED_LINK_FREQ) ==  360000000 ? IMX678_LINK_FREQ_360MHZ :	\
+	 (IMX678_FIXED_LINK_FREQ) ==  445500000 ? IMX678_LINK_FREQ_445MHZ :	\
+	 (IMX678_FIXED_LINK_FREQ) ==  594000000 ? IMX678_LINK_FREQ_594MHZ :	\
+	 (IMX678_FIXED_LINK_FREQ) ==  720000000 ? IMX678_LINK_FREQ_720MHZ :	\
+	 (IMX678_FIXED_LINK_FREQ) ==  891000000 ? IMX678_LINK_FREQ_891MHZ :	\
+	 (IMX678_FIXED_LINK_FREQ) == 1039500000 ? IMX678_LINK_FREQ_1039MHZ :	\
+	 (IMX678_FIXED_LINK_FREQ) == 1188000000 ? IMX678_LINK_FREQ_1188MHZ : -1)
+static_assert(IMX678_FIXED_LINK_IDX >= 0,
+	      "IMX678_FIXED_LINK_FREQ is not a supported link frequency");
+#endif
+
+#ifdef IMX678_FIXED_XCLK
+#define IMX678_FIXED_INCK_SEL				\
+	((IMX678_FIXED_XCLK) == 74250000 ? 0x00 :	\
+	 (IMX678_FIXED_XCLK) == 37125000 ? 0x01 :	\
+	 (IMX678_FIXED_XCLK) == 72000000 ? 0x02 :	\
+	 (IMX678_FIXED_XCLK) == 27000000 ? 0x03 :	\
+	 (IMX678_FIXED_XCLK) == 24000000 ? 0x04 :	\
+	 (IMX678_FIXED_XCLK) == 36000000 ? 0x05 :	\
+	 (IMX678_FIXED_XCLK) == 18000000 ? 0x06 :	\
+	 (IMX678_FIXED_XCLK) == 13500000 ? 0x07 : -1)
+static_assert(IMX678_FIXED_INCK_SEL >= 0,
+	      "IMX678_FIXED_XCLK is not a supported INCK rate");
+#endif
+
+#ifdef IMX678_FIXED_SYNC_MODE
+static_assert(IMX678_FIXED_SYNC_MODE >= 0 && IMX678_FIXED_SYNC_MODE <= 2,
+	      "IMX678_FIXED_SYNC_MODE must be 0, 1 or 2");
+#endif
+
+/* Nothing to downshift to when either half of the link is fixed */
+#if defined(IMX678_FIXED_LANES) || defined(IMX678_FIXED_LINK_FREQ)
+#define IMX678_FIXED_LINK
+#endif
+
 struct imx678_reg {
 	u16 address;
 	u8 val;
@@ -234,9 +415,42 @@ struct imx678_mode {
 	struct IMX678_reg_list reg_list;
 };
 
+/* Upper bound of imx678_chip_info.num_modes */
+#define IMX678_MAX_MODES                2
+
+/*
+ * What differs between the STARVIS 2 sensors sharing this driver. The
+ * register map, sync, link and timing engine are common; each chip brings
+ * its array geometry, init table, modes and the limits derived from them.
+ */
+struct imx678_chip_info {
+	const char *name;
+
+	/* Native and active pixel array */
+	u32 native_width;
+	u32 native_height;
+	struct v4l2_rect pixel_array;
+
+	/* Written once per power up, before the mode registers */
+	const struct imx678_reg *common_regs;
+	unsigned int num_common_regs;
+
+	/* min_HMAX and default_HMAX are filled in per instance */
+	const struct imx678_mode *modes;
+	unsigned int num_modes;
+
+	/* Minimum full resolution HMAX on 4 lanes, indexed like link_freqs[] */
+	const u16 *hmax_4lane;
+
+	/* Analogue gain code range, 0.3dB steps */
+	u32 gain_max;
+	bool has_hcg;
+	u32 gain_min_hcg;
+};
+
 /* IMX678 Register List */
 /* Common Modes */
-static struct imx678_reg common_regs[] = {
+static const struct imx678_reg imx678_common_regs[] = {
 	{0x301C, 0x00}, // THIN_V_EN
 	{0x301E, 0x01}, // VCMODE
 	{0x306B, 0x00}, // Sensor_register
@@ -613,11 +827,13 @@ static struct imx678_reg common_regs[] = {
 
 /* All pixel 4K60. 12-bit */
 static const struct imx678_reg mode_4k_regs_12bit[] = {
+	{0x3018, 0x00}, // WINMODE all-pixel
 	{0x301B, 0x00}, // ADDMODE non-binning
 };
 
 /* 2x2 binned 1080p60. 12-bit */
 static const struct imx678_reg mode_1080_regs_12bit[] = {
+	{0x3018, 0x00}, // WINMODE all-pixel
 	{0x301B, 0x01}, // ADDMODE binning
 };
 /* IMX678 Register List - END*/
@@ -628,7 +844,7 @@ static const struct imx678_reg mode_1080_regs_12bit[] = {
  */
 
 /* Mode configs */
-struct imx678_mode supported_modes[] = {
+static const struct imx678_mode imx678_modes[] = {
 	{
 		/* 1080p60 2x2 binning */
 		.width = 1928,
@@ -671,6 +887,26 @@ struct imx678_mode supported_modes[] = {
 	},
 };
 
+static const struct imx678_chip_info imx678_chip = {
+	.name = "imx678",
+	.native_width = IMX678_NATIVE_WIDTH,
+	.native_height = IMX678_NATIVE_HEIGHT,
+	.pixel_array = {
+		.left = IMX678_PIXEL_ARRAY_LEFT,
+		.top = IMX678_PIXEL_ARRAY_TOP,
+		.width = IMX678_PIXEL_ARRAY_WIDTH,
+		.height = IMX678_PIXEL_ARRAY_HEIGHT,
+	},
+	.common_regs = imx678_common_regs,
+	.num_common_regs = ARRAY_SIZE(imx678_common_regs),
+	.modes = imx678_modes,
+	.num_modes = ARRAY_SIZE(imx678_modes),
+	.hmax_4lane = imx678_hmax_4lane,
+	.gain_max = IMX678_ANA_GAIN_MAX_NORMAL,
+	.has_hcg = true,
+	.gain_min_hcg = IMX678_ANA_GAIN_MIN_HCG,
+};
+
 
 /*
  * The supported formats.
@@ -682,7 +918,10 @@ struct imx678_mode supported_modes[] = {
  * - h&v flips
  */
 
-/* 12bit Only */
+/*
+ * 12bit Only. There is no ClearHDR mode (WDMODE) yet, and with it neither
+ * the 16-bit combined output nor its gradation compression to 12 bits.
+ */
 static const u32 codes_normal[] = {
 	MEDIA_BUS_FMT_SRGGB12_1X12,
 	MEDIA_BUS_FMT_SGRBG12_1X12,
@@ -706,10 +945,104 @@ static const char * const imx678_supply_name[] = {
 
 #define imx678_NUM_SUPPLIES ARRAY_SIZE(imx678_supply_name)
 
+/* Frame timing registers and gain as last written to the sensor */
+struct imx678_applied {
+	u32 shr;
+	u32 vmax;
+	u16 hmax;
+	u16 gain;
+	u8 hcg;
+	u8 flips;
+	u16 roi_left;
+	u16 roi_top;
+};
+
+/*
+ * Sensors wired to one XCLR line share it: the first one to power on
+ * releases the line and the last one to power off asserts it again.
+ * Members that were supplied when the line was released wait for the same
+ * IMX678_XCLR_MIN_DELAY_US from that release instead of one after the
+ * other, a member whose supplies came up later only leaves reset then and
+ * waits from there. The group holds the GPIO: every nonexclusive request
+ * of a line returns the one descriptor, so it is put with the last member.
+ * A sensor with a line of its own, or none, is a group of one.
+ */
+struct imx678_xclr_group {
+	struct list_head list;
+	struct gpio_desc *gpio;
+	unsigned int users;	/* probed members */
+	unsigned int powered;	/* members holding XCLR released */
+	u64 released_ns;	/* XCLR last released */
+};
+
+static LIST_HEAD(imx678_xclr_groups);
+static DEFINE_MUTEX(imx678_xclr_lock);
+
+/* Exposure and gain ramp, one step committed per frame */
+struct imx678_ramp {
+	u32 frames;		/* 0 when idle */
+	u32 step;		/* steps committed so far */
+	s32 exposure_from;
+	s32 exposure_to;
+	s32 gain_from;
+	s32 gain_to;
+};
+
+/* A saved configuration, mode is NULL while the slot is empty */
+struct imx678_preset {
+	const struct imx678_mode *mode;
+	s32 hcg;
+	s32 hblank;
+	s32 vblank;
+	s32 exposure;
+	s32 gain;
+};
+
+#define IMX678_HISTORY_HFLIP            BIT(0)
+#define IMX678_HISTORY_VFLIP            BIT(1)
+
+/*
+ * One committed parameter set. This is also the record format of the
+ * debugfs history.bin file: 40 bytes, native endian, oldest first.
+ * frame_seq is the frame that was being read out when the registers were
+ * written, counted from stream on; the values take effect on the next one.
+ */
+struct imx678_history_entry {
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC */
+	__u32 index;		/* record number, gaps mean records were lost */
+	__u32 frame_seq;
+	__u32 shr;
+	__u32 vmax;
+	__u16 hmax;
+	__u16 gain;
+	__u8 hcg;
+	__u8 flips;		/* IMX678_HISTORY_[HV]FLIP */
+	__u16 roi_left;		/* readout window start in the pixel array */
+	__u16 roi_top;
+	__u16 reserved[3];
+};
+
+/*
+ * Single writer (under the driver mutex), lock-free readers. gen[] holds
+ * index + 1 of the record in each slot once it is complete, 0 while it is
+ * being rewritten, so readers can drop slots that changed under them.
+ */
+struct imx678_history {
+	struct imx678_history_entry entry[IMX678_HISTORY_LEN];
+	u32 gen[IMX678_HISTORY_LEN];
+	u32 head;
+};
+
 struct imx678 {
 	struct v4l2_subdev sd;
 	struct media_pad pad[NUM_PADS];
 
+	/* Sensor model, from the compatible or I2C id */
+	const struct imx678_chip_info *chip;
+
+	/* The chip's modes with the HMAX limits of this instance's link */
+	struct imx678_mode modes[IMX678_MAX_MODES];
+
 	unsigned int fmt_code;
 
 	struct clk *xclk;
@@ -718,11 +1051,48 @@ struct imx678 {
 	/* chosen INCK_SEL register value */
 	u8  inck_sel_val;
 
-	/* Link configurations */
+	/*
+	 * Link configurations. The timing controls are expressed against
+	 * lane_count/link_freq_idx, the link actually programmed may be slower
+	 * when link_downshift is set (see imx678_select_link()).
+	 */
 	unsigned int lane_count;
 	unsigned int link_freq_idx;
+	unsigned int cur_lane_count;
+	unsigned int cur_link_freq_idx;
+
+	/* link-frequencies listed in DT, bitmask of link_freqs[] indexes */
+	unsigned long link_freq_mask;
+
+	/* Run the slowest link that sustains the frame interval */
+	bool link_downshift;
+
+	/*
+	 * D-PHY timing override from DT, only valid for link_freqs[dphy_link].
+	 * The power-on timing is read back before the first override write and
+	 * restored for the other links.
+	 */
+	struct imx678_dphy_timing dphy;
+	struct imx678_dphy_timing dphy_default;
+	bool dphy_override;
+	bool dphy_default_read;
+	unsigned int dphy_link;
 
-	struct gpio_desc *reset_gpio;
+	/*
+	 * Link qualification: every stream on runs the test pattern at
+	 * link_freqs[qual_idx], from the fastest DT rate down, until a run
+	 * is reported good. qual_tested is set once that rate has streamed,
+	 * qual_from is the link to go back to when no rate passes.
+	 */
+	bool qualifying;
+	bool qual_tested;
+	unsigned int qual_idx;
+	unsigned int qual_from;
+
+	/* clock-noncontinuous from the endpoint, passed on to the receiver */
+	bool ep_noncont_clk;
+
+	struct imx678_xclr_group *xclr;
 	struct regulator_bulk_data supplies[imx678_NUM_SUPPLIES];
 
 	struct v4l2_ctrl_handler ctrl_handler;
@@ -738,10 +1108,26 @@ struct imx678 {
 	struct v4l2_ctrl *vblank;
 	struct v4l2_ctrl *hblank;
 	struct v4l2_ctrl *blacklevel;
+	struct v4l2_ctrl *snapshot;
+	/* Cluster: the targets are read when Ramp Frames is set with them */
+	struct v4l2_ctrl *ramp_frames;
+	struct v4l2_ctrl *ramp_exposure;
+	struct v4l2_ctrl *ramp_gain;
+	struct v4l2_ctrl *stop_mode;
+	struct v4l2_ctrl *preset_slot;
+	struct v4l2_ctrl *link_qualify;
 
 	/* Current mode */
 	const struct imx678_mode *mode;
 
+	/*
+	 * Window cropped variant of the full resolution mode, current while a
+	 * crop smaller than the pixel array is selected. Its register list
+	 * carries the window, see imx678_roi_build().
+	 */
+	struct imx678_mode roi_mode;
+	struct imx678_reg roi_regs[IMX678_ROI_REGS_MAX];
+
 	/* HCG enabled flag*/
 	bool hcg;
 
@@ -762,6 +1148,9 @@ struct imx678 {
 	u16 HMAX;
 	u32 VMAX;
 
+	/* HMAX programmed for the current link, HMAX unless downshifted */
+	u16 active_HMAX;
+
 	/*
 	 * Mutex for serialized access:
 	 * Protect sensor module set pad format and start/stop streaming safely.
@@ -773,6 +1162,77 @@ struct imx678 {
 
 	/* Rewrite common registers on stream on? */
 	bool common_regs_written;
+
+	/* Keep supplies and XCLR up on runtime suspend, only gate INCK */
+	bool standby_retention;
+
+	/*
+	 * The receiver reallocates on V4L2_EVENT_SOURCE_CHANGE, so snapshots
+	 * and presets may change the frame size while streaming
+	 */
+	bool mid_stream_resize;
+
+	/* Runtime suspended in retention, registers still valid */
+	bool retained;
+
+	/* What the sensor currently runs with, and a log of every change */
+	struct imx678_applied applied;
+	struct imx678_history history;
+
+	/*
+	 * Frame count estimate while streaming, there is no frame interrupt:
+	 * frame frame_base_seq started at frame_base_ns, frames take frame_ns.
+	 */
+	u64 frame_base_ns;
+	u64 frame_ns;
+	u32 frame_base_seq;
+
+	/*
+	 * Full resolution mode streamed in place of the binned one during a
+	 * snapshot, NULL otherwise. The timer fires in the last snapshot
+	 * frame and the work switches back.
+	 */
+	const struct imx678_mode *snapshot_mode;
+	struct hrtimer snapshot_timer;
+	struct work_struct snapshot_work;
+
+	/*
+	 * Ramp in progress, the timer fires half way through each frame and
+	 * the work commits the next step under register hold. held is set
+	 * while a step writes its controls, which then leave the history
+	 * record to it.
+	 */
+	struct imx678_ramp ramp;
+	struct hrtimer ramp_timer;
+	struct work_struct ramp_work;
+	bool held;
+
+	/*
+	 * Non-blocking stream off waiting for the frame end: streaming is
+	 * already false, the sensor still streams and holds its runtime PM
+	 * reference until the timer's work writes standby.
+	 */
+	bool stop_pending;
+	struct hrtimer stop_timer;
+	struct work_struct stop_work;
+
+	/*
+	 * Blocking stream off sleeping to the frame end without the mutex:
+	 * streaming is still true, stream on and off wait it out.
+	 */
+	bool stopping;
+
+	/*
+	 * Saved presets. While a switch to one is prepared, recording is set
+	 * and register writes are collected in rec_regs, one entry per
+	 * address, instead of going out.
+	 */
+	struct imx678_preset presets[IMX678_PRESET_NUM];
+	bool recording;
+	struct imx678_reg rec_regs[IMX678_PRESET_REGS_MAX];
+	unsigned int rec_num;
+
+	struct dentry *debugfs;
 };
 
 
@@ -781,6 +1241,60 @@ static inline struct imx678 *to_imx678(struct v4l2_subdev *_sd)
 	return container_of(_sd, struct imx678, sd);
 }
 
+/* Link and board settings, constants in fixed configuration builds */
+static inline unsigned int imx678_cur_lanes(const struct imx678 *imx678)
+{
+#ifdef IMX678_FIXED_LANES
+	return IMX678_FIXED_LANES;
+#else
+	return imx678->cur_lane_count;
+#endif
+}
+
+static inline unsigned int imx678_cur_link(const struct imx678 *imx678)
+{
+#ifdef IMX678_FIXED_LINK_FREQ
+	return IMX678_FIXED_LINK_IDX;
+#else
+	return imx678->cur_link_freq_idx;
+#endif
+}
+
+static inline bool imx678_link_downshift(const struct imx678 *imx678)
+{
+#ifdef IMX678_FIXED_LINK
+	return false;
+#else
+	return imx678->link_downshift;
+#endif
+}
+
+/* Streaming on a slower link than the one the controls are expressed in */
+static inline bool imx678_downshifted(const struct imx678 *imx678)
+{
+	return imx678_link_downshift(imx678) &&
+	       (imx678->cur_link_freq_idx != imx678->link_freq_idx ||
+		imx678->cur_lane_count != imx678->lane_count);
+}
+
+static inline u8 imx678_inck_sel(const struct imx678 *imx678)
+{
+#ifdef IMX678_FIXED_XCLK
+	return IMX678_FIXED_INCK_SEL;
+#else
+	return imx678->inck_sel_val;
+#endif
+}
+
+static inline u32 imx678_sync_mode(const struct imx678 *imx678)
+{
+#ifdef IMX678_FIXED_SYNC_MODE
+	return IMX678_FIXED_SYNC_MODE;
+#else
+	return imx678->sync_mode;
+#endif
+}
+
 static inline void get_mode_table(struct imx678 *imx678, unsigned int code,
 				  const struct imx678_mode **mode_list,
 				  unsigned int *num_modes)
@@ -795,8 +1309,8 @@ static inline void get_mode_table(struct imx678 *imx678, unsigned int code,
 	case MEDIA_BUS_FMT_SGRBG12_1X12:
 	case MEDIA_BUS_FMT_SGBRG12_1X12:
 	case MEDIA_BUS_FMT_SBGGR12_1X12:
-		*mode_list = supported_modes;
-		*num_modes = ARRAY_SIZE(supported_modes);
+		*mode_list = imx678->modes;
+		*num_modes = imx678->chip->num_modes;
 		break;
 	default:
 		*mode_list = NULL;
@@ -838,16 +1352,43 @@ static int imx678_read_reg(struct imx678 *imx678, u16 reg, u32 len, u32 *val)
 	return 0;
 }
 
+/*
+ * All register writes go through here. While recording, the bytes are
+ * collected instead and the last value written to an address wins.
+ * Returns @len like i2c_master_send().
+ */
+static int imx678_send(struct imx678 *imx678, const u8 *buf, int len)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
+	u16 reg = get_unaligned_be16(buf);
+	unsigned int i, j;
+
+	if (!imx678->recording)
+		return i2c_master_send(client, buf, len);
+
+	for (i = 2; i < len; i++) {
+		for (j = 0; j < imx678->rec_num; j++)
+			if (imx678->rec_regs[j].address == reg + i - 2)
+				break;
+		if (j == IMX678_PRESET_REGS_MAX)
+			return -ENOSPC;
+		imx678->rec_regs[j] = (struct imx678_reg){ reg + i - 2, buf[i] };
+		if (j == imx678->rec_num)
+			imx678->rec_num++;
+	}
+
+	return len;
+}
+
 /* Write registers 1 byte at a time */
 static int imx678_write_reg_1byte(struct imx678 *imx678, u16 reg, u8 val)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
 	u8 buf[3];
 	int ret;
 
 	put_unaligned_be16(reg, buf);
 	buf[2] = val;
-	ret = i2c_master_send(client, buf, 3);
+	ret = imx678_send(imx678, buf, 3);
 	if (ret != 3)
 		return ret;
 
@@ -857,14 +1398,13 @@ static int imx678_write_reg_1byte(struct imx678 *imx678, u16 reg, u8 val)
 /* Write registers 2 byte at a time */
 static int imx678_write_reg_2byte(struct imx678 *imx678, u16 reg, u16 val)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
 	u8 buf[4];
 	int ret;
 
 	put_unaligned_be16(reg, buf);
 	buf[2] = val;
 	buf[3] = val >> 8;
-	ret = i2c_master_send(client, buf, 4);
+	ret = imx678_send(imx678, buf, 4);
 	if (ret != 4)
 		return ret;
 
@@ -874,42 +1414,129 @@ static int imx678_write_reg_2byte(struct imx678 *imx678, u16 reg, u16 val)
 /* Write registers 3 byte at a time */
 static int imx678_write_reg_3byte(struct imx678 *imx678, u16 reg, u32 val)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
 	u8 buf[5];
 
 	put_unaligned_be16(reg, buf);
 	buf[2]  = val;
 	buf[3]  = val >> 8;
 	buf[4]  = val >> 16;
-	if (i2c_master_send(client, buf, 5) != 5)
+	if (imx678_send(imx678, buf, 5) != 5)
 		return -EIO;
 
 	return 0;
 }
 
-/* Write a list of 1 byte registers */
+/*
+ * Write a list of 1 byte registers, runs of consecutive addresses go out as
+ * a single auto-incrementing burst.
+ */
 static int imx678_write_regs(struct imx678 *imx678,
 			     const struct imx678_reg *regs, u32 len)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
-	unsigned int i;
+	u8 buf[2 + IMX678_BURST_MAX_LEN];
+	unsigned int i, n;
 	int ret;
 
-	for (i = 0; i < len; i++) {
-		ret = imx678_write_reg_1byte(imx678, regs[i].address,
-					     regs[i].val);
-		if (ret) {
+	for (i = 0; i < len; i += n) {
+		put_unaligned_be16(regs[i].address, buf);
+		buf[2] = regs[i].val;
+
+		for (n = 1; i + n < len && n < IMX678_BURST_MAX_LEN &&
+		     regs[i + n].address == regs[i].address + n; n++)
+			buf[2 + n] = regs[i + n].val;
+
+		ret = imx678_send(imx678, buf, 2 + n);
+		if (ret != 2 + n) {
 			dev_err_ratelimited(&client->dev,
 					    "Failed to write reg 0x%4.4x. error = %d\n",
 					    regs[i].address, ret);
 
-			return ret;
+			return ret < 0 ? ret : -EIO;
 		}
 	}
 
 	return 0;
 }
 
+/*
+ * Registers set by INCK, the link, the sync mode, the test pattern of link
+ * qualification and a DT D-PHY override, in address order so
+ * imx678_write_regs() sends them as a handful of bursts.
+ */
+#define IMX678_LINK_REGS_MAX	(11 + 2 * IMX678_DPHY_TIMING_NUM)
+
+static unsigned int imx678_link_regs(struct imx678 *imx678, struct imx678_reg *regs)
+{
+	unsigned int link = imx678_cur_link(imx678);
+	u32 sync_mode = imx678_sync_mode(imx678);
+	const u16 *dphy;
+	unsigned int n = 0, i;
+
+	regs[n++] = (struct imx678_reg){ IMX678_INCK_SEL, imx678_inck_sel(imx678) };
+	regs[n++] = (struct imx678_reg){ IMX678_DATARATE_SEL, link_freqs_reg_value[link] };
+	regs[n++] = (struct imx678_reg){ IMX678_LANEMODE,
+					 imx678_cur_lanes(imx678) == 2 ? 0x01 : 0x03 };
+
+	if (sync_mode == 1) {
+		/* External Sync Leader Mode: XHS output, XVS input */
+		regs[n++] = (struct imx678_reg){ IMX678_REG_XXS_OUTSEL, 0x08 };
+		regs[n++] = (struct imx678_reg){ IMX678_REG_XXS_DRV, 0x03 };
+		regs[n++] = (struct imx678_reg){ IMX678_REG_EXTMODE, 0x01 };
+	} else if (sync_mode == 0) {
+		/* Internal Sync Leader Mode: XHS and XVS output */
+		regs[n++] = (struct imx678_reg){ IMX678_REG_XXS_OUTSEL, 0x0A };
+		regs[n++] = (struct imx678_reg){ IMX678_REG_XXS_DRV, 0x00 };
+		regs[n++] = (struct imx678_reg){ IMX678_REG_EXTMODE, 0x00 };
+	} else {
+		/* Follower Mode: XVS and XHS input */
+		regs[n++] = (struct imx678_reg){ IMX678_REG_XXS_OUTSEL, 0x00 };
+		regs[n++] = (struct imx678_reg){ IMX678_REG_XXS_DRV, 0x0F };
+	}
+
+	regs[n++] = (struct imx678_reg){ IMX678_REG_BLKLEVEL, IMX678_BLKLEVEL_DEFAULT & 0xff };
+	regs[n++] = (struct imx678_reg){ IMX678_REG_BLKLEVEL + 1, IMX678_BLKLEVEL_DEFAULT >> 8 };
+
+	regs[n++] = (struct imx678_reg){ IMX678_REG_TPG_EN_DUOUT, imx678->qualifying };
+	if (imx678->qualifying) {
+		regs[n++] = (struct imx678_reg){ IMX678_REG_TPG_PATSEL_DUOUT,
+						 IMX678_TPG_PATSEL_TOGGLE };
+		regs[n++] = (struct imx678_reg){ IMX678_REG_TPG_COLORWIDTH, 0x00 };
+	}
+
+	/* D-PHY timing, consecutive 2 byte registers, only with a DT override */
+	if (!imx678->dphy_override)
+		return n;
+
+	dphy = (const u16 *)(link == imx678->dphy_link ? &imx678->dphy :
+						   &imx678->dphy_default);
+	for (i = 0; i < IMX678_DPHY_TIMING_NUM; i++) {
+		regs[n++] = (struct imx678_reg){ IMX678_REG_TCLKPOST + 2 * i, dphy[i] & 0xff };
+		regs[n++] = (struct imx678_reg){ IMX678_REG_TCLKPOST + 2 * i + 1, dphy[i] >> 8 };
+	}
+
+	return n;
+}
+
+/* The D-PHY timing the sensor currently runs with */
+static int imx678_read_dphy(struct imx678 *imx678, struct imx678_dphy_timing *t)
+{
+	u16 *dst = (u16 *)t;
+	unsigned int i;
+	u32 val;
+	int ret;
+
+	for (i = 0; i < IMX678_DPHY_TIMING_NUM; i++) {
+		ret = imx678_read_reg(imx678, IMX678_REG_TCLKPOST + 2 * i, 2, &val);
+		if (ret)
+			return ret;
+		/* Low byte at the lower address */
+		dst[i] = (val & 0xff) << 8 | val >> 8;
+	}
+
+	return 0;
+}
+
 /* Hold register values until hold is disabled */
 static inline void imx678_register_hold(struct imx678 *imx678, bool hold)
 {
@@ -933,7 +1560,7 @@ static u32 imx678_get_format_code(struct imx678 *imx678, u32 code)
 static void imx678_set_default_format(struct imx678 *imx678)
 {
 	/* Set default mode to max resolution */
-	imx678->mode = &supported_modes[0];
+	imx678->mode = &imx678->modes[0];
 	imx678->fmt_code = MEDIA_BUS_FMT_SRGGB12_1X12;
 }
 
@@ -949,8 +1576,8 @@ static int imx678_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
 	mutex_lock(&imx678->mutex);
 
 	/* Initialize try_fmt for the image pad */
-	try_fmt_img->width = supported_modes[0].width;
-	try_fmt_img->height = supported_modes[0].height;
+	try_fmt_img->width = imx678->modes[0].width;
+	try_fmt_img->height = imx678->modes[0].height;
 	try_fmt_img->code = imx678_get_format_code(imx678, MEDIA_BUS_FMT_SRGGB12_1X12);
 
 	try_fmt_img->field = V4L2_FIELD_NONE;
@@ -963,33 +1590,60 @@ static int imx678_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
 
 	/* Initialize try_crop */
 	try_crop = v4l2_subdev_state_get_crop(fh->state, IMAGE_PAD);
-	try_crop->left = IMX678_PIXEL_ARRAY_LEFT;
-	try_crop->top = IMX678_PIXEL_ARRAY_TOP;
-	try_crop->width = IMX678_PIXEL_ARRAY_WIDTH;
-	try_crop->height = IMX678_PIXEL_ARRAY_HEIGHT;
+	*try_crop = imx678->chip->pixel_array;
 
 	mutex_unlock(&imx678->mutex);
 
 	return 0;
 }
 
+/*
+ * __v4l2_ctrl_modify_range() with the default clamped into the new range,
+ * which the framework rejects with -ERANGE otherwise. Pass the control's
+ * fixed default, never the current value: a range event is only raised
+ * when a limit or the default moves, and a default that follows the value
+ * would make each value change read as a range change.
+ */
+static void imx678_modify_range(struct v4l2_ctrl *ctrl, s64 min, s64 max,
+				u64 step, s64 def)
+{
+	__v4l2_ctrl_modify_range(ctrl, min, max, step, clamp(def, min, max));
+}
+
+/* The longest exposure is the frame length less the minimum SHR */
+static void imx678_update_exposure_limits(struct imx678 *imx678)
+{
+	imx678_modify_range(imx678->exposure, IMX678_EXPOSURE_MIN,
+			    imx678->VMAX - IMX678_SHR_MIN, IMX678_EXPOSURE_STEP,
+			    IMX678_EXPOSURE_DEFAULT);
+}
+
 /* For HDR mode, Gain is limited to 0~80 and HCG is disabled
  * For Normal mode, Gain is limited to 0~240
  */
 static void imx678_update_gain_limits(struct imx678 *imx678)
 {
+		const struct imx678_chip_info *chip = imx678->chip;
 		bool hcg_on = imx678->hcg;
-		u32 min = hcg_on ? IMX678_ANA_GAIN_MIN_HCG : IMX678_ANA_GAIN_MIN_NORMAL;
+		u32 min = hcg_on ? chip->gain_min_hcg : IMX678_ANA_GAIN_MIN_NORMAL;
 		u32 cur = imx678->gain->val;
 
-		__v4l2_ctrl_modify_range(imx678->gain,
-					 min, IMX678_ANA_GAIN_MAX_NORMAL,
-					 IMX678_ANA_GAIN_STEP,
-					 clamp(cur, min, IMX678_ANA_GAIN_MAX_NORMAL));
+		imx678_modify_range(imx678->gain, min, chip->gain_max,
+				    IMX678_ANA_GAIN_STEP, IMX678_ANA_GAIN_DEFAULT);
 
-		if (cur < min || cur > IMX678_ANA_GAIN_MAX_NORMAL)
+		if (cur < min || cur > chip->gain_max)
 			__v4l2_ctrl_s_ctrl(imx678->gain,
-					   clamp(cur, min, IMX678_ANA_GAIN_MAX_NORMAL));
+					   clamp(cur, min, chip->gain_max));
+}
+
+/* Minimum 4K HMAX for a link, before the per mode hmax_div */
+static u32 imx678_link_hmax_factor(struct imx678 *imx678, unsigned int link_freq_idx,
+				   unsigned int lane_count)
+{
+	const u32 base_4lane = imx678->chip->hmax_4lane[link_freq_idx];
+	const u32 lane_scale = (lane_count == 2) ? 2 : 1;
+
+	return base_4lane * lane_scale;
 }
 
 static void imx678_update_hmax(struct imx678 *imx678)
@@ -997,21 +1651,114 @@ static void imx678_update_hmax(struct imx678 *imx678)
 
 	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
 
-	const u32 base_4lane = HMAX_table_4lane_4K[imx678->link_freq_idx];
-	const u32 lane_scale = (imx678->lane_count == 2) ? 2 : 1;
-	const u32 factor     = base_4lane * lane_scale;
+	const u32 factor = imx678_link_hmax_factor(imx678, imx678->link_freq_idx,
+						   imx678->lane_count);
 
 	dev_info(&client->dev, "Upadte minimum HMAX\n");
-	dev_info(&client->dev, "\tbase_4lane: %d\n", base_4lane);
-	dev_info(&client->dev, "\tlane_scale: %d\n", lane_scale);
 	dev_info(&client->dev, "\tfactor: %d\n", factor);
 
-	for (unsigned int i = 0; i < ARRAY_SIZE(supported_modes); ++i) {
-		u32 h = factor / supported_modes[i].hmax_div;
-		supported_modes[i].min_HMAX     = h;
-		supported_modes[i].default_HMAX = h;
+	for (unsigned int i = 0; i < imx678->chip->num_modes; ++i) {
+		u32 h = factor / imx678->modes[i].hmax_div;
+		imx678->modes[i].min_HMAX     = h;
+		imx678->modes[i].default_HMAX = h;
+	}
+
+	/* Cropping shortens the frame, not the line */
+	if (imx678->roi_mode.hmax_div) {
+		u32 h = factor / imx678->roi_mode.hmax_div;
+
+		imx678->roi_mode.min_HMAX     = h;
+		imx678->roi_mode.default_HMAX = h;
+	}
+
+}
+
+static u16 imx678_hblank_to_hmax(struct imx678 *imx678, u32 hblank)
+{
+	const struct imx678_mode *mode = imx678->mode;
+	u64 pixel_rate;
+	u64 hmax;
+
+	pixel_rate = (u64)mode->width * IMX678_PIXEL_RATE;
+	do_div(pixel_rate, mode->min_HMAX);
+	hmax = (u64)(mode->width + hblank) * IMX678_PIXEL_RATE;
+	do_div(hmax, pixel_rate);
+
+	return hmax;
+}
+
+/* Convert a line count to lines of the active link's HMAX */
+static u32 imx678_link_lines(struct imx678 *imx678, u32 lines)
+{
+	if (imx678->active_HMAX == imx678->HMAX)
+		return lines;
+
+	return div_u64((u64)lines * imx678->HMAX, imx678->active_HMAX);
+}
+
+/*
+ * Pick the link to stream on. Without link_downshift this is always the DT
+ * link. Otherwise walk the DT link-frequencies from the slowest and take the
+ * first one (2 lanes before 4) that keeps the frame interval VMAX * HMAX:
+ * the line is stretched to the link's minimum HMAX and VMAX shrinks to
+ * match, which must still fit the mode. Exposure and VMAX are rescaled to
+ * the stretched line when written, the controls keep their meaning.
+ *
+ * Runs whenever the blanking changes while not streaming, so that the
+ * receiver reads the right LINK_FREQ before it starts.
+ */
+static void imx678_select_link(struct imx678 *imx678, u32 vblank, u32 hblank)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
+	const struct imx678_mode *mode = imx678->mode;
+	unsigned int idx = imx678->link_freq_idx;
+	unsigned int lanes = imx678->lane_count;
+	unsigned int i, l;
+	u16 active_hmax;
+
+	imx678->HMAX = imx678_hblank_to_hmax(imx678, hblank);
+	imx678->VMAX = (mode->height + vblank) & ~1u;
+	active_hmax = imx678->HMAX;
+
+	/* Qualification streams at the rate under test */
+	if (imx678_link_downshift(imx678) && !imx678->qualifying) {
+		u64 frame = (u64)imx678->VMAX * imx678->HMAX;
+
+		for (i = 0; i < ARRAY_SIZE(link_freqs); i++) {
+			if (!(imx678->link_freq_mask & BIT(i)))
+				continue;
+
+			for (l = 2; l <= imx678->lane_count; l += 2) {
+				u32 hmax = imx678_link_hmax_factor(imx678, i, l) / mode->hmax_div;
+
+				/* A line the HMAX register can't hold rules the link out */
+				hmax = max_t(u32, hmax, imx678->HMAX);
+				if (hmax <= IMX678_HMAX_MAX &&
+				    div_u64(frame, hmax) >= mode->min_VMAX) {
+					idx = i;
+					lanes = l;
+					active_hmax = hmax;
+					goto found;
+				}
+			}
+		}
 	}
 
+found:
+	imx678->active_HMAX = active_hmax;
+
+	if (idx == imx678->cur_link_freq_idx && lanes == imx678->cur_lane_count)
+		return;
+
+	dev_info(&client->dev, "Link: %llu Hz x %u lanes, HMAX %u\n",
+		 link_freqs[idx], lanes, active_hmax);
+
+	imx678->cur_link_freq_idx = idx;
+	imx678->cur_lane_count = lanes;
+	__v4l2_ctrl_s_ctrl(imx678->link_freq, idx);
+
+	/* Data rate, lane mode and any D-PHY override live in the link block */
+	imx678->common_regs_written = false;
 }
 
 static void imx678_set_framing_limits(struct imx678 *imx678)
@@ -1030,7 +1777,7 @@ static void imx678_set_framing_limits(struct imx678 *imx678)
 
 	pixel_rate = (u64)mode->width * IMX678_PIXEL_RATE;
 	do_div(pixel_rate, mode->min_HMAX);
-	__v4l2_ctrl_modify_range(imx678->pixel_rate, pixel_rate, pixel_rate, 1, pixel_rate);
+	imx678_modify_range(imx678->pixel_rate, pixel_rate, pixel_rate, 1, pixel_rate);
 
 	//int default_hblank = mode->default_HMAX*IMX678_PIXEL_RATE/72000000-IMX678_NATIVE_WIDTH;
 	default_hblank = mode->default_HMAX * pixel_rate;
@@ -1041,56 +1788,733 @@ static void imx678_set_framing_limits(struct imx678 *imx678)
 	do_div(max_hblank, IMX678_PIXEL_RATE);
 	max_hblank = max_hblank - mode->width;
 
-	__v4l2_ctrl_modify_range(imx678->hblank, 0, max_hblank, 1, default_hblank);
+	imx678_modify_range(imx678->hblank, 0, max_hblank, 1, default_hblank);
 	__v4l2_ctrl_s_ctrl(imx678->hblank, default_hblank);
 
 	/* Update limits and set FPS to default */
-	__v4l2_ctrl_modify_range(imx678->vblank, mode->min_VMAX - mode->height,
-				 IMX678_VMAX_MAX - mode->height,
-				 1, mode->default_VMAX - mode->height);
+	imx678_modify_range(imx678->vblank, mode->min_VMAX - mode->height,
+			    IMX678_VMAX_MAX - mode->height,
+			    1, mode->default_VMAX - mode->height);
 	__v4l2_ctrl_s_ctrl(imx678->vblank, mode->default_VMAX - mode->height);
 
-	__v4l2_ctrl_modify_range(imx678->exposure, IMX678_EXPOSURE_MIN,
-			 imx678->VMAX - IMX678_SHR_MIN_CLEARHDR, 1,
-				IMX678_EXPOSURE_DEFAULT);
+	/* Already done by the VBLANK write unless VBLANK kept its value */
+	imx678->VMAX = (mode->height + imx678->vblank->val) & ~1u;
+	imx678_update_exposure_limits(imx678);
 	dev_info(&client->dev, "default vmax: %lld x hmax: %d\n", mode->min_VMAX, mode->min_HMAX);
 	dev_info(&client->dev, "Setting default HBLANK : %llu, VBLANK : %llu PixelRate: %lld\n",
 		 default_hblank, mode->default_VMAX - mode->height, pixel_rate);
 
+	if (!imx678->streaming)
+		imx678_select_link(imx678, imx678->vblank->val, imx678->hblank->val);
 }
 
-static int imx678_set_ctrl(struct v4l2_ctrl *ctrl)
+/*
+ * Express the controls against link_freqs[@idx], as if DT listed it first.
+ * The blanking limits follow and the link block is written again at the
+ * next stream on, also when the link stays, for the test pattern.
+ */
+static void imx678_set_link(struct imx678 *imx678, unsigned int idx)
 {
-	struct imx678 *imx678 = container_of(ctrl->handler, struct imx678, ctrl_handler);
-	const struct imx678_mode *mode = imx678->mode;
-	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
-	int ret = 0;
-	/*
-	 * Applying V4L2 control value only happens
-	 * when power is up for streaming
-	 */
-	if (pm_runtime_get_if_in_use(&client->dev) == 0)
-		return 0;
+	imx678->link_freq_idx = idx;
+	imx678->common_regs_written = false;
+	imx678_set_framing_limits(imx678);
+}
 
-	switch (ctrl->id) {
-	case V4L2_CID_EXPOSURE:
-		{
-			u32 shr;
+/* The fastest DT link rate below link_freqs[@idx], -1 if there is none */
+static int imx678_qualify_next(struct imx678 *imx678, int idx)
+{
+	while (--idx >= 0)
+		if (imx678->link_freq_mask & BIT(idx))
+			return idx;
 
-			shr = (imx678->VMAX - ctrl->val)  & ~1u; //Always a multiple of 2
-			dev_info(&client->dev, "V4L2_CID_EXPOSURE : %d\n", ctrl->val);
-			dev_info(&client->dev, "\tVMAX:%d, HMAX:%d\n", imx678->VMAX, imx678->HMAX);
-			dev_info(&client->dev, "\tSHR:%d\n", shr);
+	return -1;
+}
 
-			ret = imx678_write_reg_3byte(imx678, IMX678_REG_SHR, shr);
-			if (ret)
-				dev_err_ratelimited(&client->dev,
-						    "Failed to write reg 0x%4.4x. error = %d\n",
-						    IMX678_REG_SHR, ret);
-		break;
-		}
-	case V4L2_CID_IMX585_HCG_GAIN:
-		{
+/* Start or abort a qualification, the link only changes between streams */
+static int imx678_qualify(struct imx678 *imx678, bool on)
+{
+	lockdep_assert_held(&imx678->mutex);
+
+	if (on == imx678->qualifying)
+		return 0;
+	if (imx678->streaming)
+		return -EBUSY;
+
+	if (on) {
+		imx678->qual_from = imx678->link_freq_idx;
+		imx678->qual_idx = imx678_qualify_next(imx678, ARRAY_SIZE(link_freqs));
+		imx678->qual_tested = false;
+		imx678->qualifying = true;
+		imx678_set_link(imx678, imx678->qual_idx);
+	} else {
+		imx678->qualifying = false;
+		imx678_set_link(imx678, imx678->qual_from);
+	}
+
+	return 0;
+}
+
+/*
+ * Result of the runs at the rate under test. A pass ends the qualification
+ * and records the rate as the highest one that works: the link drops to it
+ * now if it was faster, and max_link_freq keeps it there at the next probe.
+ * A fail moves on to the next slower rate, or ends the qualification back
+ * on the original link when there is none.
+ */
+static int imx678_qualify_result(struct imx678 *imx678, bool pass)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
+	u64 rate = link_freqs[imx678->qual_idx];
+	int next;
+
+	lockdep_assert_held(&imx678->mutex);
+
+	if (!imx678->qualifying || !imx678->qual_tested)
+		return -EINVAL;
+	if (imx678->streaming)
+		return -EBUSY;
+
+	if (pass) {
+		dev_info(&client->dev, "Link qualified at %llu Hz\n", rate);
+		WRITE_ONCE(max_link_freq, rate);
+		imx678->qualifying = false;
+		imx678_set_link(imx678, min(imx678->qual_idx, imx678->qual_from));
+		__v4l2_ctrl_s_ctrl(imx678->link_qualify, 0);
+		return 0;
+	}
+
+	if (test_and_set_bit(imx678->qual_idx, &imx678_qual_warned))
+		dev_dbg(&client->dev, "Link failed qualification at %llu Hz\n", rate);
+	else
+		dev_warn(&client->dev, "Link failed qualification at %llu Hz\n", rate);
+	next = imx678_qualify_next(imx678, imx678->qual_idx);
+	if (next < 0) {
+		dev_err(&client->dev, "No link rate passed qualification\n");
+		imx678->qualifying = false;
+		imx678_set_link(imx678, imx678->qual_from);
+		__v4l2_ctrl_s_ctrl(imx678->link_qualify, 0);
+		return 0;
+	}
+
+	imx678->qual_idx = next;
+	imx678->qual_tested = false;
+	imx678_set_link(imx678, next);
+
+	return 0;
+}
+
+/* Frame length in ns for the programmed VMAX and HMAX */
+static u64 imx678_frame_ns(u32 vmax, u16 hmax)
+{
+	return div_u64((u64)vmax * hmax * 1000000, IMX678_PIXEL_RATE / 1000);
+}
+
+static u32 imx678_frame_seq(struct imx678 *imx678, u64 now)
+{
+	if (!imx678->streaming || !imx678->frame_ns || now < imx678->frame_base_ns)
+		return imx678->frame_base_seq;
+
+	return imx678->frame_base_seq +
+	       div64_u64(now - imx678->frame_base_ns, imx678->frame_ns);
+}
+
+/* Restart the frame count estimate when the frame length changes */
+static void imx678_frame_rebase(struct imx678 *imx678, u64 now)
+{
+	u64 frame_ns = imx678_frame_ns(imx678->applied.vmax, imx678->applied.hmax);
+	u32 seq;
+
+	if (frame_ns == imx678->frame_ns)
+		return;
+
+	seq = imx678_frame_seq(imx678, now);
+	if (imx678->frame_ns)
+		imx678->frame_base_ns += (u64)(seq - imx678->frame_base_seq) * imx678->frame_ns;
+	imx678->frame_base_seq = seq;
+	imx678->frame_ns = frame_ns;
+}
+
+/* Record what the sensor runs with as of @now */
+static void __imx678_history_record(struct imx678 *imx678, u64 now)
+{
+	struct imx678_history *h = &imx678->history;
+	u32 index = h->head;
+	unsigned int slot = index & (IMX678_HISTORY_LEN - 1);
+	struct imx678_history_entry *e = &h->entry[slot];
+
+	lockdep_assert_held(&imx678->mutex);
+
+	imx678_frame_rebase(imx678, now);
+
+	WRITE_ONCE(h->gen[slot], 0);
+	smp_wmb();
+
+	e->timestamp_ns = now;
+	e->index = index;
+	e->frame_seq = imx678_frame_seq(imx678, now);
+	e->shr = imx678->applied.shr;
+	e->vmax = imx678->applied.vmax;
+	e->hmax = imx678->applied.hmax;
+	e->gain = imx678->applied.gain;
+	e->hcg = imx678->applied.hcg;
+	e->flips = imx678->applied.flips;
+	e->roi_left = imx678->applied.roi_left;
+	e->roi_top = imx678->applied.roi_top;
+	memset(e->reserved, 0, sizeof(e->reserved));
+
+	smp_wmb();
+	WRITE_ONCE(h->gen[slot], index + 1);
+	smp_store_release(&h->head, index + 1);
+}
+
+static void imx678_history_record(struct imx678 *imx678)
+{
+	__imx678_history_record(imx678, ktime_get_ns());
+}
+
+/* Copy out the complete records, oldest first, returns how many */
+static unsigned int imx678_history_snapshot(struct imx678_history *h,
+					    struct imx678_history_entry *out)
+{
+	u32 head = smp_load_acquire(&h->head);
+	u32 index = head > IMX678_HISTORY_LEN ? head - IMX678_HISTORY_LEN : 0;
+	unsigned int n = 0;
+
+	for (; index != head; index++) {
+		unsigned int slot = index & (IMX678_HISTORY_LEN - 1);
+
+		if (READ_ONCE(h->gen[slot]) != index + 1)
+			continue;
+		smp_rmb();
+		out[n] = data_race(h->entry[slot]);
+		smp_rmb();
+		if (READ_ONCE(h->gen[slot]) == index + 1)
+			n++;
+	}
+
+	return n;
+}
+
+/* The mode with the most pixels, the one a snapshot switches to */
+static const struct imx678_mode *imx678_full_mode(struct imx678 *imx678)
+{
+	const struct imx678_mode *full = &imx678->modes[0];
+	unsigned int i;
+
+	for (i = 1; i < imx678->chip->num_modes; i++)
+		if (imx678->modes[i].width * imx678->modes[i].height >
+		    full->width * full->height)
+			full = &imx678->modes[i];
+
+	return full;
+}
+
+static bool imx678_roi_active(struct imx678 *imx678)
+{
+	return imx678->mode == &imx678->roi_mode;
+}
+
+/* Record the readout window of @mode once its registers are written */
+static void imx678_apply_window(struct imx678 *imx678, const struct imx678_mode *mode)
+{
+	imx678->applied.roi_left = mode->crop.left - imx678->chip->pixel_array.left;
+	imx678->applied.roi_top = mode->crop.top - imx678->chip->pixel_array.top;
+}
+
+static void imx678_notify_resolution(struct imx678 *imx678)
+{
+	static const struct v4l2_event ev = {
+		.type = V4L2_EVENT_SOURCE_CHANGE,
+		.u.src_change.changes = V4L2_EVENT_SRC_CH_RESOLUTION,
+	};
+
+	v4l2_subdev_notify_event(&imx678->sd, &ev);
+}
+
+/* Mode registers under group hold, they take effect at the next frame start */
+static int imx678_write_mode_held(struct imx678 *imx678,
+				  const struct imx678_mode *mode)
+{
+	int ret;
+
+	imx678_register_hold(imx678, true);
+	ret = imx678_write_regs(imx678, mode->reg_list.regs, mode->reg_list.num_of_regs);
+	imx678_register_hold(imx678, false);
+	if (!ret)
+		imx678_apply_window(imx678, mode);
+
+	return ret;
+}
+
+/*
+ * Stream @frames full resolution frames. Written during frame n, the mode
+ * latches at the start of frame n + 1; the switch back is written half a
+ * frame into frame n + @frames so that it latches right after it. The
+ * frame estimate is the one of the history, a VBLANK change during the
+ * snapshot shifts the end by the difference.
+ */
+static int imx678_snapshot_start(struct imx678 *imx678, u32 frames)
+{
+	const struct imx678_mode *full = imx678_full_mode(imx678);
+	u64 now = ktime_get_ns();
+	u64 end;
+	u32 seq;
+	int ret;
+
+	lockdep_assert_held(&imx678->mutex);
+
+	if (!imx678->streaming || imx678->stopping || imx678->snapshot_mode ||
+	    !imx678->frame_ns)
+		return -EBUSY;
+	/* A receiver set up for the binned frames would get larger ones */
+	if (!imx678->mid_stream_resize)
+		return -EBUSY;
+	/* Already full resolution, or a frame too short for it (a small window) */
+	if (full == imx678->mode || imx678->VMAX < full->min_VMAX)
+		return -EINVAL;
+
+	ret = imx678_write_mode_held(imx678, full);
+	if (ret)
+		return ret;
+
+	seq = imx678_frame_seq(imx678, now);
+	end = imx678->frame_base_ns +
+	      (u64)(seq - imx678->frame_base_seq + frames) * imx678->frame_ns +
+	      imx678->frame_ns / 2;
+
+	imx678->snapshot_mode = full;
+	hrtimer_start(&imx678->snapshot_timer, ns_to_ktime(end), HRTIMER_MODE_ABS);
+	imx678_notify_resolution(imx678);
+
+	return 0;
+}
+
+/* Leaves the control alone, callers outside its s_ctrl reset it */
+static void imx678_snapshot_end(struct imx678 *imx678, bool restore)
+{
+	lockdep_assert_held(&imx678->mutex);
+
+	if (!imx678->snapshot_mode)
+		return;
+
+	/* The callback only queues the work, which checks snapshot_mode */
+	hrtimer_try_to_cancel(&imx678->snapshot_timer);
+	if (restore)
+		imx678_write_mode_held(imx678, imx678->mode);
+	imx678->snapshot_mode = NULL;
+	imx678_notify_resolution(imx678);
+}
+
+static enum hrtimer_restart imx678_snapshot_timer_fn(struct hrtimer *timer)
+{
+	struct imx678 *imx678 = container_of(timer, struct imx678, snapshot_timer);
+
+	queue_work(system_highpri_wq, &imx678->snapshot_work);
+
+	return HRTIMER_NORESTART;
+}
+
+static void imx678_snapshot_work(struct work_struct *work)
+{
+	struct imx678 *imx678 = container_of(work, struct imx678, snapshot_work);
+
+	mutex_lock(&imx678->mutex);
+	if (imx678->snapshot_mode) {
+		imx678_snapshot_end(imx678, true);
+		__v4l2_ctrl_s_ctrl(imx678->snapshot, 0);
+	}
+	mutex_unlock(&imx678->mutex);
+}
+
+/* Arm the ramp timer half way through the frame after the current one */
+static void imx678_ramp_arm(struct imx678 *imx678)
+{
+	u32 seq = imx678_frame_seq(imx678, ktime_get_ns());
+	u64 next = imx678->frame_base_ns +
+		   (u64)(seq - imx678->frame_base_seq + 1) * imx678->frame_ns +
+		   imx678->frame_ns / 2;
+
+	hrtimer_start(&imx678->ramp_timer, ns_to_ktime(next), HRTIMER_MODE_ABS);
+}
+
+/*
+ * Commit the next step of the ramp: exposure and gain are interpolated
+ * linearly, in lines and in 0.3dB gain steps, and written through their
+ * controls so that the VMAX and gain limits apply and the controls read
+ * back what the sensor runs with. HCG is kept as set unless the gain
+ * falls below the HCG minimum, then the switch to LCG is written in the
+ * same register hold as that gain. The switch is one way: conversion gain
+ * is the application's choice, as when setting the gain directly, so a
+ * ramp up from LCG through the HCG minimum ends in LCG.
+ */
+static void imx678_ramp_step(struct imx678 *imx678)
+{
+	struct imx678_ramp *r = &imx678->ramp;
+	u32 step = ++r->step;
+	s32 exposure = r->exposure_from +
+		       div_s64((s64)(r->exposure_to - r->exposure_from) * step, r->frames);
+	s32 gain = r->gain_from +
+		   div_s64((s64)(r->gain_to - r->gain_from) * step, r->frames);
+
+	lockdep_assert_held(&imx678->mutex);
+
+	imx678->held = true;
+	imx678_register_hold(imx678, true);
+	if (imx678->hcg && gain < imx678->chip->gain_min_hcg)
+		__v4l2_ctrl_s_ctrl(imx678->hcg_ctrl, 0);
+	__v4l2_ctrl_s_ctrl(imx678->exposure, exposure);
+	__v4l2_ctrl_s_ctrl(imx678->gain, gain);
+	imx678_register_hold(imx678, false);
+	imx678->held = false;
+
+	imx678_history_record(imx678);
+}
+
+/*
+ * Ramp from the current exposure and gain to the targets over @frames
+ * frames. The targets are clustered with the frame count, so they hold
+ * the values of the same S_EXT_CTRLS call whatever order it lists them
+ * in. The first step is written now and latches at the next frame start,
+ * the others follow one per frame from the ramp timer, which also resets
+ * the control one frame after the last one. A ramp started while one runs
+ * continues from wherever that one got to.
+ */
+static int imx678_ramp_start(struct imx678 *imx678, u32 frames)
+{
+	struct imx678_ramp *r = &imx678->ramp;
+
+	lockdep_assert_held(&imx678->mutex);
+
+	if (!imx678->streaming || imx678->stopping || !imx678->frame_ns)
+		return -EBUSY;
+
+	hrtimer_try_to_cancel(&imx678->ramp_timer);
+
+	r->frames = frames;
+	r->step = 0;
+	r->exposure_from = imx678->exposure->cur.val;
+	r->exposure_to = imx678->ramp_exposure->val;
+	r->gain_from = imx678->gain->cur.val;
+	r->gain_to = imx678->ramp_gain->val;
+
+	imx678_ramp_step(imx678);
+	imx678_ramp_arm(imx678);
+
+	return 0;
+}
+
+/* Leaves exposure and gain at the last committed step */
+static void imx678_ramp_stop(struct imx678 *imx678)
+{
+	lockdep_assert_held(&imx678->mutex);
+
+	/* The callback only queues the work, which checks frames */
+	hrtimer_try_to_cancel(&imx678->ramp_timer);
+	imx678->ramp.frames = 0;
+}
+
+static enum hrtimer_restart imx678_ramp_timer_fn(struct hrtimer *timer)
+{
+	struct imx678 *imx678 = container_of(timer, struct imx678, ramp_timer);
+
+	queue_work(system_highpri_wq, &imx678->ramp_work);
+
+	return HRTIMER_NORESTART;
+}
+
+static void imx678_ramp_work(struct work_struct *work)
+{
+	struct imx678 *imx678 = container_of(work, struct imx678, ramp_work);
+	struct imx678_ramp *r = &imx678->ramp;
+
+	mutex_lock(&imx678->mutex);
+	if (r->frames && r->step < r->frames) {
+		imx678_ramp_step(imx678);
+		imx678_ramp_arm(imx678);
+	} else if (r->frames) {
+		r->frames = 0;
+		__v4l2_ctrl_s_ctrl(imx678->ramp_frames, 0);
+	}
+	mutex_unlock(&imx678->mutex);
+}
+
+/* Saves the mode and the exposure, gain and blanking controls */
+static int imx678_preset_save(struct imx678 *imx678, u32 slot)
+{
+	struct imx678_preset *p = &imx678->presets[slot];
+
+	lockdep_assert_held(&imx678->mutex);
+
+	/* A preset switches between the modes of the table, not windows */
+	if (imx678_roi_active(imx678))
+		return -EINVAL;
+
+	p->mode = imx678->mode;
+	p->hcg = imx678->hcg_ctrl ? imx678->hcg_ctrl->cur.val : 0;
+	p->hblank = imx678->hblank->cur.val;
+	p->vblank = imx678->vblank->cur.val;
+	p->exposure = imx678->exposure->cur.val;
+	p->gain = imx678->gain->cur.val;
+
+	return 0;
+}
+
+/*
+ * Set the mode and controls of @p. The limits each one depends on are
+ * updated first, also while powered down, where the controls leave them
+ * to stream on.
+ */
+static void imx678_preset_set(struct imx678 *imx678, const struct imx678_preset *p)
+{
+	struct v4l2_ctrl *hcg = imx678->hcg_ctrl;
+
+	if (p->mode != imx678->mode) {
+		imx678->mode = p->mode;
+		imx678_set_framing_limits(imx678);
+	}
+
+	if (hcg && !(hcg->flags & V4L2_CTRL_FLAG_INACTIVE)) {
+		__v4l2_ctrl_s_ctrl(hcg, p->hcg);
+		imx678->hcg = p->hcg;
+		imx678_update_gain_limits(imx678);
+	}
+	__v4l2_ctrl_s_ctrl(imx678->hblank, p->hblank);
+	__v4l2_ctrl_s_ctrl(imx678->vblank, p->vblank);
+	imx678->VMAX = (imx678->mode->height + p->vblank) & ~1u;
+	imx678_update_exposure_limits(imx678);
+	__v4l2_ctrl_s_ctrl(imx678->exposure, p->exposure);
+	__v4l2_ctrl_s_ctrl(imx678->gain, p->gain);
+}
+
+/*
+ * Registers a preset covers, as the sensor has them for @mode and the
+ * values in @a. Multi-byte registers are little endian.
+ */
+static unsigned int imx678_preset_image(const struct imx678_mode *mode,
+					const struct imx678_applied *a,
+					struct imx678_reg *regs)
+{
+	static const struct {
+		u16 reg;
+		u8 len;
+	} fields[] = {
+		{ IMX678_REG_SHR, 3 },
+		{ IMX678_REG_VMAX, 3 },
+		{ IMX678_REG_HMAX, 2 },
+		{ IMX678_REG_ANALOG_GAIN, 2 },
+		{ IMX678_REG_FDG_SEL0, 1 },
+	};
+	const u32 vals[] = { a->shr, a->vmax, a->hmax, a->gain, a->hcg };
+	unsigned int n = 0, i, j;
+
+	for (i = 0; i < mode->reg_list.num_of_regs; i++)
+		regs[n++] = mode->reg_list.regs[i];
+
+	for (i = 0; i < ARRAY_SIZE(fields); i++)
+		for (j = 0; j < fields[i].len; j++)
+			regs[n++] = (struct imx678_reg){ fields[i].reg + j,
+							 vals[i] >> (8 * j) };
+
+	return n;
+}
+
+/*
+ * Keep the recorded writes that differ from @image, in address order so
+ * that imx678_write_regs() merges them into bursts.
+ */
+static void imx678_preset_delta(struct imx678 *imx678,
+				const struct imx678_reg *image, unsigned int len)
+{
+	struct imx678_reg *regs = imx678->rec_regs;
+	struct imx678_reg r;
+	unsigned int n = 0, i, j;
+
+	for (i = 0; i < imx678->rec_num; i++) {
+		for (j = 0; j < len; j++)
+			if (image[j].address == regs[i].address)
+				break;
+		if (j < len && image[j].val == regs[i].val)
+			continue;
+
+		r = regs[i];
+		for (j = n; j > 0 && regs[j - 1].address > r.address; j--)
+			regs[j] = regs[j - 1];
+		regs[j] = r;
+		n++;
+	}
+
+	imx678->rec_num = n;
+}
+
+/*
+ * Switch to a saved preset. Powered down this only sets the mode and the
+ * controls. While streaming the switch is prepared with writes recorded
+ * instead of sent: the mode table and every control of the preset are
+ * programmed as stream on would, so the record holds the full register
+ * image of the preset. Against the image the sensor runs with, what
+ * differs is written in one register hold and latches as a whole at the
+ * next frame start.
+ */
+static int imx678_preset_apply(struct imx678 *imx678, u32 slot)
+{
+	const struct imx678_preset *p = &imx678->presets[slot];
+	const struct imx678_mode *from = imx678->mode;
+	struct v4l2_ctrl *ctrls[] = {
+		imx678->hcg_ctrl, imx678->hblank, imx678->vblank,
+		imx678->exposure, imx678->gain,
+	};
+	struct imx678_reg image[IMX678_PRESET_REGS_MAX];
+	unsigned int n, i;
+	int ret = 0;
+
+	lockdep_assert_held(&imx678->mutex);
+
+	if (!p->mode)
+		return -EINVAL;
+	/* Both write the same registers from their timers */
+	if (imx678->snapshot_mode || imx678->ramp.frames)
+		return -EBUSY;
+
+	if (!imx678->streaming) {
+		imx678_preset_set(imx678, p);
+		return 0;
+	}
+
+	/*
+	 * The frame size only changes for a receiver that follows it, as for
+	 * set_fmt. The link was downshifted for the blanking of the running
+	 * mode.
+	 */
+	if (p->mode != from &&
+	    (!imx678->mid_stream_resize || imx678_downshifted(imx678)))
+		return -EBUSY;
+
+	n = imx678_preset_image(from, &imx678->applied, image);
+
+	imx678->held = true;
+	imx678->recording = true;
+	imx678->rec_num = 0;
+	imx678_preset_set(imx678, p);
+	if (p->mode != from)
+		ret = imx678_write_regs(imx678, p->mode->reg_list.regs,
+					p->mode->reg_list.num_of_regs);
+	for (i = 0; !ret && i < ARRAY_SIZE(ctrls); i++) {
+		if (!ctrls[i])
+			continue;
+		ctrls[i]->val = ctrls[i]->cur.val;
+		ret = ctrls[i]->ops->s_ctrl(ctrls[i]);
+	}
+	imx678->recording = false;
+	imx678->held = false;
+	if (ret)
+		return ret;
+
+	imx678_preset_delta(imx678, image, n);
+	if (imx678->rec_num) {
+		imx678_register_hold(imx678, true);
+		ret = imx678_write_regs(imx678, imx678->rec_regs, imx678->rec_num);
+		imx678_register_hold(imx678, false);
+		if (ret)
+			return ret;
+	}
+
+	if (p->mode != from) {
+		imx678_apply_window(imx678, p->mode);
+		imx678_notify_resolution(imx678);
+	}
+	if (imx678->rec_num)
+		imx678_history_record(imx678);
+
+	return 0;
+}
+
+static bool imx678_history_tracked(u32 id)
+{
+	switch (id) {
+	case V4L2_CID_EXPOSURE:
+	case V4L2_CID_VBLANK:
+	case V4L2_CID_HBLANK:
+	case V4L2_CID_ANALOGUE_GAIN:
+	case V4L2_CID_IMX678_HCG_GAIN:
+	case V4L2_CID_HFLIP:
+	case V4L2_CID_VFLIP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static int imx678_set_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct imx678 *imx678 = container_of(ctrl->handler, struct imx678, ctrl_handler);
+	const struct imx678_mode *mode = imx678->mode;
+	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
+	int ret = 0;
+
+	/* The blanking decides which link can carry the frame */
+	if (!imx678->streaming) {
+		if (ctrl->id == V4L2_CID_VBLANK)
+			imx678_select_link(imx678, ctrl->val, imx678->hblank->cur.val);
+		else if (ctrl->id == V4L2_CID_HBLANK)
+			imx678_select_link(imx678, imx678->vblank->cur.val, ctrl->val);
+	}
+
+	/* A snapshot returns to the running stream, there has to be one */
+	if (ctrl->id == V4L2_CID_IMX678_SNAPSHOT && ctrl->val && !imx678->streaming)
+		return -EBUSY;
+
+	/* Ramps are paced by the frames of the running stream */
+	if (ctrl->id == V4L2_CID_IMX678_RAMP_FRAMES && ctrl->is_new && ctrl->val &&
+	    !imx678->streaming)
+		return -EBUSY;
+
+	/* Link qualification works between streams */
+	if (ctrl->id == V4L2_CID_IMX678_LINK_QUALIFY)
+		return imx678_qualify(imx678, ctrl->val);
+	if (ctrl->id == V4L2_CID_IMX678_LINK_TEST_PASS)
+		return imx678_qualify_result(imx678, true);
+	if (ctrl->id == V4L2_CID_IMX678_LINK_TEST_FAIL)
+		return imx678_qualify_result(imx678, false);
+
+	/* Presets go through the other controls, powered or not */
+	if (ctrl->id == V4L2_CID_IMX678_PRESET_SAVE)
+		return imx678_preset_save(imx678, imx678->preset_slot->val);
+	if (ctrl->id == V4L2_CID_IMX678_PRESET_APPLY)
+		return imx678_preset_apply(imx678, imx678->preset_slot->val);
+
+	/*
+	 * Applying V4L2 control value only happens
+	 * when power is up for streaming, not with runtime PM disabled in
+	 * system sleep. The last frame of a deferred stop is left alone,
+	 * stream on applies the values.
+	 */
+	if (imx678->stop_pending || pm_runtime_get_if_in_use(&client->dev) <= 0)
+		return 0;
+
+	switch (ctrl->id) {
+	case V4L2_CID_EXPOSURE:
+		{
+			u32 vmax = imx678_link_lines(imx678, imx678->VMAX) & ~1u;
+			u32 exposure = imx678_link_lines(imx678, ctrl->val);
+			u32 shr;
+
+			exposure = min(exposure, vmax - IMX678_SHR_MIN);
+			shr = (vmax - exposure)  & ~1u; //Always a multiple of 2
+			dev_info(&client->dev, "V4L2_CID_EXPOSURE : %d\n", ctrl->val);
+			dev_info(&client->dev, "\tVMAX:%d, HMAX:%d\n", imx678->VMAX, imx678->HMAX);
+			dev_info(&client->dev, "\tSHR:%d\n", shr);
+
+			ret = imx678_write_reg_3byte(imx678, IMX678_REG_SHR, shr);
+			if (ret)
+				dev_err_ratelimited(&client->dev,
+						    "Failed to write reg 0x%4.4x. error = %d\n",
+						    IMX678_REG_SHR, ret);
+			else
+				imx678->applied.shr = shr;
+		break;
+		}
+	case V4L2_CID_IMX678_HCG_GAIN:
+		{
 		if (ctrl->flags & V4L2_CTRL_FLAG_INACTIVE)
 			break;
 		imx678->hcg = ctrl->val;
@@ -1102,6 +2526,8 @@ static int imx678_set_ctrl(struct v4l2_ctrl *ctrl)
 			dev_err_ratelimited(&client->dev,
 					    "Failed to write reg 0x%4.4x. error = %d\n",
 					    IMX678_REG_FDG_SEL0, ret);
+		else
+			imx678->applied.hcg = ctrl->val;
 		dev_info(&client->dev, "V4L2_CID_HCG_ENABLE: %d\n", ctrl->val);
 		break;
 		}
@@ -1116,56 +2542,80 @@ static int imx678_set_ctrl(struct v4l2_ctrl *ctrl)
 		if (ret)
 			dev_err_ratelimited(&client->dev,
 					    "ANALOG_GAIN write failed (%d)\n", ret);
+		else
+			imx678->applied.gain = gain;
 		break;
 		}
 	case V4L2_CID_VBLANK:
 		{
-			u32 current_exposure = imx678->exposure->cur.val;
-			u32 minSHR = IMX678_SHR_MIN;
 			/*
 			 * The VBLANK control may change the limits of usable exposure, so check
 			 * and adjust if necessary.
 			 */
 			imx678->VMAX = (mode->height + ctrl->val) & ~1u; //Always a multiple of 2
 
-			/* New maximum exposure limits,
-			 * modifying the range and make sure we are not exceed the new maximum.
-			 */
-			current_exposure = clamp_t(u32, current_exposure, IMX678_EXPOSURE_MIN,
-						   imx678->VMAX - minSHR);
-			__v4l2_ctrl_modify_range(imx678->exposure, IMX678_EXPOSURE_MIN,
-						 imx678->VMAX - minSHR, 1,
-						 current_exposure);
+			/* New maximum exposure, the framework clamps the current one */
+			imx678_update_exposure_limits(imx678);
 
 			dev_info(&client->dev, "V4L2_CID_VBLANK : %d\n", ctrl->val);
 			dev_info(&client->dev, "\tVMAX:%d, HMAX:%d\n", imx678->VMAX, imx678->HMAX);
 			dev_info(&client->dev, "Update exposure limits: max:%d, min:%d, current:%d\n",
-				 imx678->VMAX - minSHR,
-				 IMX678_EXPOSURE_MIN, current_exposure);
+				 imx678->VMAX - IMX678_SHR_MIN,
+				 IMX678_EXPOSURE_MIN, imx678->exposure->cur.val);
 
-			ret = imx678_write_reg_3byte(imx678, IMX678_REG_VMAX, imx678->VMAX);
+			ret = imx678_write_reg_3byte(imx678, IMX678_REG_VMAX,
+						     imx678_link_lines(imx678, imx678->VMAX) & ~1u);
 			if (ret)
 				dev_err_ratelimited(&client->dev,
 						    "Failed to write reg 0x%4.4x. error = %d\n",
 						    IMX678_REG_VMAX, ret);
+			else
+				imx678->applied.vmax = imx678_link_lines(imx678, imx678->VMAX) & ~1u;
 		break;
 		}
 
 	case V4L2_CID_HBLANK:
 		{
-			u64 pixel_rate;
-			u64 hmax;
+			bool downshifted = imx678_downshifted(imx678);
+			u32 hmax;
 
-			pixel_rate = (u64)mode->width * IMX678_PIXEL_RATE;
-			do_div(pixel_rate, mode->min_HMAX);
-			hmax = (u64)(mode->width + ctrl->val) * IMX678_PIXEL_RATE;
-			do_div(hmax, pixel_rate);
+			hmax = imx678_hblank_to_hmax(imx678, ctrl->val);
 			imx678->HMAX = hmax;
 
+			/*
+			 * Keep the line within what the downshifted link can carry,
+			 * and within the 16-bit HMAX register: select_link() never
+			 * picks a link that needs more, this only guards the write.
+			 */
+			if (downshifted) {
+				u32 link_hmax = imx678_link_hmax_factor(imx678,
+									imx678->cur_link_freq_idx,
+									imx678->cur_lane_count) /
+						mode->hmax_div;
+
+				hmax = min_t(u32, max(hmax, link_hmax), IMX678_HMAX_MAX);
+			}
+			imx678->active_HMAX = hmax;
+
 			dev_info(&client->dev, "V4L2_CID_HBLANK : %d\n", ctrl->val);
 			dev_info(&client->dev, "\tHMAX : %d\n", imx678->HMAX);
 
 			ret = imx678_write_reg_2byte(imx678, IMX678_REG_HMAX, hmax);
+			if (!ret)
+				imx678->applied.hmax = hmax;
+			if (!ret && downshifted) {
+				u32 vmax = imx678_link_lines(imx678, imx678->VMAX) & ~1u;
+				u32 exposure = imx678_link_lines(imx678, imx678->exposure->cur.val);
+
+				exposure = min(exposure, vmax - IMX678_SHR_MIN);
+				ret = imx678_write_reg_3byte(imx678, IMX678_REG_VMAX, vmax);
+				ret |= imx678_write_reg_3byte(imx678, IMX678_REG_SHR,
+							      (vmax - exposure) & ~1u);
+				if (!ret) {
+					imx678->applied.vmax = vmax;
+					imx678->applied.shr = (vmax - exposure) & ~1u;
+				}
+			}
 			if (ret)
 				dev_err_ratelimited(&client->dev,
 						    "Failed to write reg 0x%4.4x. error = %d\n",
@@ -1179,6 +2629,10 @@ static int imx678_set_ctrl(struct v4l2_ctrl *ctrl)
 			dev_err_ratelimited(&client->dev,
 					    "Failed to write reg 0x%4.4x. error = %d\n",
 					    IMX678_FLIP_WINMODEH, ret);
+		else if (ctrl->val)
+			imx678->applied.flips |= IMX678_HISTORY_HFLIP;
+		else
+			imx678->applied.flips &= ~IMX678_HISTORY_HFLIP;
 		break;
 	case V4L2_CID_VFLIP:
 		dev_info(&client->dev, "V4L2_CID_VFLIP : %d\n", ctrl->val);
@@ -1187,6 +2641,10 @@ static int imx678_set_ctrl(struct v4l2_ctrl *ctrl)
 			dev_err_ratelimited(&client->dev,
 					    "Failed to write reg 0x%4.4x. error = %d\n",
 					    IMX678_FLIP_WINMODEV, ret);
+		else if (ctrl->val)
+			imx678->applied.flips |= IMX678_HISTORY_VFLIP;
+		else
+			imx678->applied.flips &= ~IMX678_HISTORY_VFLIP;
 		break;
 	case V4L2_CID_BRIGHTNESS:
 		{
@@ -1203,6 +2661,27 @@ static int imx678_set_ctrl(struct v4l2_ctrl *ctrl)
 					    IMX678_REG_BLKLEVEL, ret);
 		break;
 		}
+	case V4L2_CID_IMX678_SNAPSHOT:
+		if (ctrl->val)
+			ret = imx678_snapshot_start(imx678, ctrl->val);
+		else
+			imx678_snapshot_end(imx678, true);
+		break;
+	case V4L2_CID_IMX678_STOP_MODE:
+		/* Read at stream off */
+		break;
+	case V4L2_CID_IMX678_PRESET_SLOT:
+		/* Read by the preset buttons */
+		break;
+	case V4L2_CID_IMX678_RAMP_FRAMES:
+		/* A target set on its own waits for the next ramp */
+		if (!ctrl->is_new)
+			break;
+		if (ctrl->val)
+			ret = imx678_ramp_start(imx678, ctrl->val);
+		else
+			imx678_ramp_stop(imx678);
+		break;
 	default:
 		dev_info(&client->dev,
 			 "ctrl(id:0x%x,val:0x%x) is not handled\n",
@@ -1210,6 +2689,10 @@ static int imx678_set_ctrl(struct v4l2_ctrl *ctrl)
 		break;
 	}
 
+	/* Stream start records the whole set once the handler setup is done */
+	if (!ret && imx678->streaming && !imx678->held && imx678_history_tracked(ctrl->id))
+		imx678_history_record(imx678);
+
 	pm_runtime_put(&client->dev);
 
 	return ret;
@@ -1221,7 +2704,7 @@ static const struct v4l2_ctrl_ops imx678_ctrl_ops = {
 
 static const struct v4l2_ctrl_config imx678_cfg_hcg = {
 	.ops = &imx678_ctrl_ops,
-	.id = V4L2_CID_IMX585_HCG_GAIN,
+	.id = V4L2_CID_IMX678_HCG_GAIN,
 	.name = "HCG Enable",
 	.type = V4L2_CTRL_TYPE_BOOLEAN,
 	.min  = 0,
@@ -1230,6 +2713,115 @@ static const struct v4l2_ctrl_config imx678_cfg_hcg = {
 	.def  = 0,
 };
 
+/* Where a ramp goes to, see imx678_ramp_start() */
+static const struct v4l2_ctrl_config imx678_cfg_ramp_exposure = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_RAMP_EXPOSURE,
+	.name = "Ramp Exposure Target",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min  = IMX678_EXPOSURE_MIN,
+	.max  = IMX678_EXPOSURE_MAX,
+	.step = IMX678_EXPOSURE_STEP,
+	.def  = IMX678_EXPOSURE_DEFAULT,
+};
+
+static const struct v4l2_ctrl_config imx678_cfg_ramp_gain = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_RAMP_GAIN,
+	.name = "Ramp Gain Target",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min  = IMX678_ANA_GAIN_MIN_NORMAL,
+	.step = IMX678_ANA_GAIN_STEP,
+	.def  = IMX678_ANA_GAIN_DEFAULT,
+};
+
+/* Frames to ramp over, reads back 0 once the ramp is done, 0 stops it */
+static const struct v4l2_ctrl_config imx678_cfg_ramp_frames = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_RAMP_FRAMES,
+	.name = "Ramp Frames",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.flags = V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+	.min  = 0,
+	.max  = IMX678_RAMP_MAX,
+	.step = 1,
+};
+
+/* How stream off ends the frame being read out, see imx678_stream_off() */
+static const struct v4l2_ctrl_config imx678_cfg_stop_mode = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_STOP_MODE,
+	.name = "Stream Stop Mode",
+	.type = V4L2_CTRL_TYPE_MENU,
+	.min  = 0,
+	.max  = ARRAY_SIZE(stop_mode_menu) - 1,
+	.def  = IMX678_STOP_IMMEDIATE,
+	.qmenu = stop_mode_menu,
+};
+
+/* Preset the save and apply buttons act on */
+static const struct v4l2_ctrl_config imx678_cfg_preset_slot = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_PRESET_SLOT,
+	.name = "Preset Slot",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min  = 0,
+	.max  = IMX678_PRESET_NUM - 1,
+	.step = 1,
+};
+
+static const struct v4l2_ctrl_config imx678_cfg_preset_save = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_PRESET_SAVE,
+	.name = "Preset Save",
+	.type = V4L2_CTRL_TYPE_BUTTON,
+};
+
+static const struct v4l2_ctrl_config imx678_cfg_preset_apply = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_PRESET_APPLY,
+	.name = "Preset Apply",
+	.type = V4L2_CTRL_TYPE_BUTTON,
+};
+
+/* Stream the test pattern at each DT link rate in turn, reads back 0 when done */
+static const struct v4l2_ctrl_config imx678_cfg_link_qualify = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_LINK_QUALIFY,
+	.name = "Link Qualification",
+	.type = V4L2_CTRL_TYPE_BOOLEAN,
+	.min  = 0,
+	.max  = 1,
+	.step = 1,
+};
+
+/* Verdict on the streams at the rate under test, from the receiver or a checksum */
+static const struct v4l2_ctrl_config imx678_cfg_link_test_pass = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_LINK_TEST_PASS,
+	.name = "Link Test Pass",
+	.type = V4L2_CTRL_TYPE_BUTTON,
+};
+
+static const struct v4l2_ctrl_config imx678_cfg_link_test_fail = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_LINK_TEST_FAIL,
+	.name = "Link Test Fail",
+	.type = V4L2_CTRL_TYPE_BUTTON,
+};
+
+/* Number of full resolution frames to stream before going back, 0 cancels */
+static const struct v4l2_ctrl_config imx678_cfg_snapshot = {
+	.ops = &imx678_ctrl_ops,
+	.id = V4L2_CID_IMX678_SNAPSHOT,
+	.name = "Snapshot Frames",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.flags = V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+	.min  = 0,
+	.max  = IMX678_SNAPSHOT_MAX,
+	.step = 1,
+};
+
 static int imx678_enum_mbus_code(struct v4l2_subdev *sd,
 				 struct v4l2_subdev_state *sd_state,
 				 struct v4l2_subdev_mbus_code_enum *code)
@@ -1346,7 +2938,8 @@ static int imx678_get_pad_format(struct v4l2_subdev *sd,
 		fmt->format = *try_fmt;
 	} else {
 		if (fmt->pad == IMAGE_PAD) {
-			imx678_update_image_pad_format(imx678, imx678->mode, fmt);
+			imx678_update_image_pad_format(imx678, imx678->snapshot_mode ?:
+							       imx678->mode, fmt);
 			fmt->format.code =
 				   imx678_get_format_code(imx678, imx678->fmt_code);
 		} else {
@@ -1366,6 +2959,7 @@ static int imx678_set_pad_format(struct v4l2_subdev *sd,
 	struct v4l2_mbus_framefmt *framefmt;
 	const struct imx678_mode *mode;
 	struct imx678 *imx678 = to_imx678(sd);
+	int ret = 0;
 
 	if (fmt->pad >= NUM_PADS)
 		return -EINVAL;
@@ -1384,12 +2978,22 @@ static int imx678_set_pad_format(struct v4l2_subdev *sd,
 						  width, height,
 						  fmt->format.width,
 						  fmt->format.height);
+		/* The size of the selected window keeps it */
+		if (fmt->which == V4L2_SUBDEV_FORMAT_ACTIVE && imx678_roi_active(imx678) &&
+		    fmt->format.width == imx678->roi_mode.width &&
+		    fmt->format.height == imx678->roi_mode.height)
+			mode = &imx678->roi_mode;
 		imx678_update_image_pad_format(imx678, mode, fmt);
 		if (fmt->which == V4L2_SUBDEV_FORMAT_TRY) {
 			framefmt = v4l2_subdev_state_get_format(sd_state, fmt->pad);
 			*framefmt = fmt->format;
 		} else if (imx678->mode != mode ||
 			   imx678->fmt_code != fmt->format.code) {
+			/* The mode registers are only written at stream start */
+			if (imx678->streaming) {
+				ret = -EBUSY;
+				goto out_unlock;
+			}
 			imx678->mode = mode;
 			imx678->fmt_code = fmt->format.code;
 			imx678_set_framing_limits(imx678);
@@ -1404,9 +3008,10 @@ static int imx678_set_pad_format(struct v4l2_subdev *sd,
 		}
 	}
 
+out_unlock:
 	mutex_unlock(&imx678->mutex);
 
-	return 0;
+	return ret;
 }
 
 static const struct v4l2_rect *
@@ -1429,44 +3034,34 @@ static int imx678_start_streaming(struct imx678 *imx678)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
 	const struct IMX678_reg_list *reg_list;
+	struct imx678_reg link_regs[IMX678_LINK_REGS_MAX];
+	unsigned int n;
 	int ret;
 
 	if (!imx678->common_regs_written) {
-		ret = imx678_write_regs(imx678, common_regs, ARRAY_SIZE(common_regs));
+		ret = imx678_write_regs(imx678, imx678->chip->common_regs,
+					imx678->chip->num_common_regs);
 		if (ret) {
 			dev_err(&client->dev, "%s failed to set common settings\n", __func__);
 			return ret;
 		}
 
-		imx678_write_reg_1byte(imx678, IMX678_INCK_SEL, imx678->inck_sel_val);
-		imx678_write_reg_2byte(imx678, IMX678_REG_BLKLEVEL, IMX678_BLKLEVEL_DEFAULT);
-		imx678_write_reg_1byte(imx678, IMX678_DATARATE_SEL,
-					   link_freqs_reg_value[imx678->link_freq_idx]);
+		if (imx678->dphy_override && !imx678->dphy_default_read) {
+			ret = imx678_read_dphy(imx678, &imx678->dphy_default);
+			if (ret) {
+				dev_err(&client->dev, "%s failed to read D-PHY timing\n", __func__);
+				return ret;
+			}
+			imx678->dphy_default_read = true;
+		}
 
-		if (imx678->lane_count == 2)
-			imx678_write_reg_1byte(imx678, IMX678_LANEMODE, 0x01);
-		else
-			imx678_write_reg_1byte(imx678, IMX678_LANEMODE, 0x03);
-
-		if (imx678->sync_mode == 1) { //External Sync Leader Mode
-			dev_info(&client->dev, "External Sync Leader Mode, enable XVS input\n");
-			imx678_write_reg_1byte(imx678, IMX678_REG_EXTMODE, 0x01);
-			// Enable XHS output, but XVS is input
-			imx678_write_reg_1byte(imx678, IMX678_REG_XXS_DRV, 0x03);
-			// Disable XVS OUT
-			imx678_write_reg_1byte(imx678, IMX678_REG_XXS_OUTSEL, 0x08);
-		} else if (imx678->sync_mode == 0) { //Internal Sync Leader Mode
-			dev_info(&client->dev, "Internal Sync Leader Mode, enable output\n");
-			imx678_write_reg_1byte(imx678, IMX678_REG_EXTMODE, 0x00);
-			// Enable XHS and XVS output
-			imx678_write_reg_1byte(imx678, IMX678_REG_XXS_DRV, 0x00);
-			imx678_write_reg_1byte(imx678, IMX678_REG_XXS_OUTSEL, 0x0A);
-		} else {
-			dev_info(&client->dev, "Follower Mode, enable XVS/XHS input\n");
-			//For follower mode, switch both of them to input
-			imx678_write_reg_1byte(imx678, IMX678_REG_XXS_DRV, 0x0F);
-			imx678_write_reg_1byte(imx678, IMX678_REG_XXS_OUTSEL, 0x00);
+		n = imx678_link_regs(imx678, link_regs);
+		ret = imx678_write_regs(imx678, link_regs, n);
+		if (ret) {
+			dev_err(&client->dev, "%s failed to set link settings\n", __func__);
+			return ret;
 		}
+
 		imx678->common_regs_written = true;
 		dev_info(&client->dev, "common_regs_written\n");
 	}
@@ -1478,6 +3073,7 @@ static int imx678_start_streaming(struct imx678 *imx678)
 		dev_err(&client->dev, "%s failed to set mode\n", __func__);
 		return ret;
 	}
+	imx678_apply_window(imx678, imx678->mode);
 
 	/* Disable digital clamp */
 	imx678_write_reg_1byte(imx678, IMX678_REG_DIGITAL_CLAMP, 0);
@@ -1489,7 +3085,7 @@ static int imx678_start_streaming(struct imx678 *imx678)
 		return ret;
 	}
 
-	if (imx678->sync_mode <= 1) {
+	if (imx678_sync_mode(imx678) <= 1) {
 		dev_info(&client->dev, "imx678 Leader mode enabled\n");
 		imx678_write_reg_1byte(imx678, IMX678_REG_XMSTA, 0x00);
 	}
@@ -1497,6 +3093,14 @@ static int imx678_start_streaming(struct imx678 *imx678)
 	/* Set stream on register */
 	ret = imx678_write_reg_1byte(imx678, IMX678_REG_MODE_SELECT, IMX678_MODE_STREAMING);
 
+	/*
+	 * Frame 0 starts now, with everything the handler setup just wrote,
+	 * not after the settle delay below.
+	 */
+	imx678->frame_base_ns = ktime_get_ns();
+	imx678->frame_base_seq = 0;
+	imx678->frame_ns = 0;
+
 	dev_info(&client->dev, "Start Streaming\n");
 	usleep_range(IMX678_STREAM_DELAY_US, IMX678_STREAM_DELAY_US + IMX678_STREAM_DELAY_RANGE_US);
 	return ret;
@@ -1516,6 +3120,128 @@ static void imx678_stop_streaming(struct imx678 *imx678)
 		dev_err(&client->dev, "%s failed to stop stream\n", __func__);
 }
 
+/*
+ * Time left until the frame being read out is complete, 0 in vertical
+ * blanking. From the frame estimate, there is no frame interrupt: the
+ * active lines plus a margin are read out from the start of the frame.
+ * In follower mode the frame timing comes from outside, 0.
+ */
+static u64 imx678_stop_wait_ns(struct imx678 *imx678, u64 now)
+{
+	const struct imx678_mode *mode = imx678->snapshot_mode ?: imx678->mode;
+	u64 start, readout;
+	u32 seq;
+
+	lockdep_assert_held(&imx678->mutex);
+
+	if (imx678_sync_mode(imx678) == 2)
+		return 0;
+
+	imx678_frame_rebase(imx678, now);
+	if (!imx678->frame_ns)
+		return 0;
+
+	seq = imx678_frame_seq(imx678, now);
+	start = imx678->frame_base_ns + (u64)(seq - imx678->frame_base_seq) * imx678->frame_ns;
+	readout = div_u64(imx678->frame_ns *
+			  min_t(u32, mode->height + IMX678_STOP_MARGIN_LINES, imx678->VMAX),
+			  imx678->VMAX);
+
+	return now < start + readout ? start + readout - now : 0;
+}
+
+/* Write standby for a deferred stop and drop the reference it kept */
+static void imx678_stop_flush(struct imx678 *imx678)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
+
+	lockdep_assert_held(&imx678->mutex);
+
+	if (!imx678->stop_pending)
+		return;
+
+	/* The callback only queues the work, which checks stop_pending */
+	hrtimer_try_to_cancel(&imx678->stop_timer);
+	imx678->stop_pending = false;
+	imx678_stop_streaming(imx678);
+	pm_runtime_put(&client->dev);
+}
+
+/*
+ * Stream off as the stop mode control says: standby right away, which
+ * truncates the frame being read out, or once it is complete. Waiting
+ * blocks for up to IMX678_STOP_WAIT_MAX_US; the deferred variant returns
+ * at once and leaves standby and the runtime PM reference to the stop
+ * timer, for up to IMX678_STOP_DEFER_MAX_US. Longer waits stop right away.
+ * The blocking wait drops the mutex, so controls and the timer works are
+ * not held up behind it.
+ */
+static void imx678_stream_off(struct imx678 *imx678)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
+	u64 now = ktime_get_ns();
+	u64 wait = 0;
+	u32 us;
+
+	lockdep_assert_held(&imx678->mutex);
+
+	if (imx678->stop_mode->cur.val != IMX678_STOP_IMMEDIATE)
+		wait = imx678_stop_wait_ns(imx678, now);
+	us = DIV_ROUND_UP_ULL(wait, 1000);
+
+	if (us && us <= IMX678_STOP_DEFER_MAX_US &&
+	    imx678->stop_mode->cur.val == IMX678_STOP_FRAME_END_DEFERRED) {
+		imx678->stop_pending = true;
+		hrtimer_start(&imx678->stop_timer, ns_to_ktime(now + wait),
+			      HRTIMER_MODE_ABS);
+		return;
+	}
+
+	if (us && us <= IMX678_STOP_WAIT_MAX_US) {
+		imx678->stopping = true;
+		mutex_unlock(&imx678->mutex);
+		usleep_range(us, us + 100);
+		mutex_lock(&imx678->mutex);
+		imx678->stopping = false;
+	}
+
+	imx678_stop_streaming(imx678);
+	pm_runtime_put(&client->dev);
+}
+
+static enum hrtimer_restart imx678_stop_timer_fn(struct hrtimer *timer)
+{
+	struct imx678 *imx678 = container_of(timer, struct imx678, stop_timer);
+
+	queue_work(system_highpri_wq, &imx678->stop_work);
+
+	return HRTIMER_NORESTART;
+}
+
+static void imx678_stop_work(struct work_struct *work)
+{
+	struct imx678 *imx678 = container_of(work, struct imx678, stop_work);
+
+	mutex_lock(&imx678->mutex);
+	imx678_stop_flush(imx678);
+	mutex_unlock(&imx678->mutex);
+}
+
+/*
+ * Wait for the snapshot, ramp and stop timers and works. Callers end all
+ * three under the mutex first: a work that is running then arms nothing,
+ * and each timer is cancelled before the work it would queue.
+ */
+static void imx678_cancel_deferred(struct imx678 *imx678)
+{
+	hrtimer_cancel(&imx678->snapshot_timer);
+	cancel_work_sync(&imx678->snapshot_work);
+	hrtimer_cancel(&imx678->ramp_timer);
+	cancel_work_sync(&imx678->ramp_work);
+	hrtimer_cancel(&imx678->stop_timer);
+	cancel_work_sync(&imx678->stop_work);
+}
+
 static int imx678_set_stream(struct v4l2_subdev *sd, int enable)
 {
 	struct imx678 *imx678 = to_imx678(sd);
@@ -1523,12 +3249,23 @@ static int imx678_set_stream(struct v4l2_subdev *sd, int enable)
 	int ret = 0;
 
 	mutex_lock(&imx678->mutex);
+	/* Another caller is waiting for the frame end to stop */
+	if (imx678->stopping) {
+		mutex_unlock(&imx678->mutex);
+		return enable ? -EBUSY : 0;
+	}
 	if (imx678->streaming == enable) {
 		mutex_unlock(&imx678->mutex);
 		return 0;
 	}
 
 	if (enable) {
+		/* The last frame of a deferred stop is cut short */
+		imx678_stop_flush(imx678);
+
+		imx678_select_link(imx678, imx678->vblank->cur.val,
+				   imx678->hblank->cur.val);
+
 		ret = pm_runtime_get_sync(&client->dev);
 		if (ret < 0) {
 			pm_runtime_put_noidle(&client->dev);
@@ -1543,36 +3280,148 @@ static int imx678_set_stream(struct v4l2_subdev *sd, int enable)
 		if (ret)
 			goto err_rpm_put;
 	} else {
-		imx678_stop_streaming(imx678);
-		pm_runtime_put(&client->dev);
+		/* Stream on writes the binned mode again */
+		imx678_snapshot_end(imx678, false);
+		__v4l2_ctrl_s_ctrl(imx678->snapshot, 0);
+		imx678_ramp_stop(imx678);
+		__v4l2_ctrl_s_ctrl(imx678->ramp_frames, 0);
+		imx678_stream_off(imx678);
 	}
 
 	imx678->streaming = enable;
 
-	/* vflip/hflip and hdr mode cannot change during streaming */
+	/* Frame 0 started at the stream on write, with the handler setup */
+	if (enable) {
+		if (imx678->qualifying)
+			imx678->qual_tested = true;
+		__imx678_history_record(imx678, imx678->frame_base_ns);
+	}
+
+	/*
+	 * vflip/hflip, hdr mode and the CSI-2 link setup cannot
+	 * change during streaming
+	 */
 	__v4l2_ctrl_grab(imx678->vflip, enable);
 	__v4l2_ctrl_grab(imx678->hflip, enable);
+	__v4l2_ctrl_grab(imx678->link_qualify, enable);
+
+	mutex_unlock(&imx678->mutex);
+
+	return ret;
+
+err_rpm_put:
+	pm_runtime_put(&client->dev);
+err_unlock:
+	mutex_unlock(&imx678->mutex);
+
+	return ret;
+}
+
+/* Power/clock management functions */
+static struct imx678_xclr_group *imx678_xclr_get(struct device *dev)
+{
+	struct imx678_xclr_group *g;
+	struct gpio_desc *gpio;
+
+	/* Under the lock, so the last member of a group can't put it meanwhile */
+	mutex_lock(&imx678_xclr_lock);
+	gpio = gpiod_get_optional(dev, "reset",
+				  GPIOD_OUT_LOW | GPIOD_FLAGS_BIT_NONEXCLUSIVE);
+	if (IS_ERR(gpio)) {
+		g = ERR_CAST(gpio);
+		goto out;
+	}
+
+	list_for_each_entry(g, &imx678_xclr_groups, list) {
+		if (gpio && g->gpio == gpio) {
+			g->users++;
+			goto out;
+		}
+	}
+
+	g = kzalloc(sizeof(*g), GFP_KERNEL);
+	if (!g) {
+		gpiod_put(gpio);
+		g = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+	g->gpio = gpio;
+	g->users = 1;
+	list_add(&g->list, &imx678_xclr_groups);
+out:
+	mutex_unlock(&imx678_xclr_lock);
+
+	return g;
+}
+
+static void imx678_xclr_put(struct imx678_xclr_group *g)
+{
+	mutex_lock(&imx678_xclr_lock);
+	if (!--g->users) {
+		list_del(&g->list);
+		gpiod_put(g->gpio);
+		kfree(g);
+	}
+	mutex_unlock(&imx678_xclr_lock);
+}
+
+/*
+ * Release XCLR, or join the members that did, and wait until it has settled
+ * for a sensor whose supplies came up at @supplied_ns.
+ */
+static void imx678_xclr_release(struct imx678 *imx678, u64 supplied_ns)
+{
+	struct imx678_xclr_group *g = imx678->xclr;
+	u64 now, ready;
+
+	mutex_lock(&imx678_xclr_lock);
+	if (!g->powered++) {
+		gpiod_set_value_cansleep(g->gpio, 1);
+		g->released_ns = ktime_get_ns();
+	}
+	ready = max(g->released_ns, supplied_ns) + IMX678_XCLR_MIN_DELAY_US * 1000ULL;
+	mutex_unlock(&imx678_xclr_lock);
 
-	mutex_unlock(&imx678->mutex);
+	now = ktime_get_ns();
+	if (now < ready) {
+		u32 us = DIV_ROUND_UP_ULL(ready - now, 1000);
 
-	return ret;
+		usleep_range(us, us + IMX678_XCLR_DELAY_RANGE_US);
+	}
+}
 
-err_rpm_put:
-	pm_runtime_put(&client->dev);
-err_unlock:
-	mutex_unlock(&imx678->mutex);
+static void imx678_xclr_assert(struct imx678 *imx678)
+{
+	struct imx678_xclr_group *g = imx678->xclr;
 
-	return ret;
+	mutex_lock(&imx678_xclr_lock);
+	if (!--g->powered)
+		gpiod_set_value_cansleep(g->gpio, 0);
+	mutex_unlock(&imx678_xclr_lock);
 }
 
-/* Power/clock management functions */
 static int imx678_power_on(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct imx678 *imx678 = to_imx678(sd);
+	u64 supplied_ns;
 	int ret;
 
+	if (imx678->retained) {
+		ret = clk_prepare_enable(imx678->xclk);
+		if (ret) {
+			dev_err(&client->dev, "%s: failed to enable clock\n",
+				__func__);
+			return ret;
+		}
+
+		imx678->retained = false;
+		usleep_range(IMX678_INCK_SETTLE_US,
+			     IMX678_INCK_SETTLE_US + IMX678_INCK_SETTLE_RANGE_US);
+		return 0;
+	}
+
 	ret = regulator_bulk_enable(imx678_NUM_SUPPLIES,
 					imx678->supplies);
 	if (ret) {
@@ -1580,6 +3429,7 @@ static int imx678_power_on(struct device *dev)
 			__func__);
 		return ret;
 	}
+	supplied_ns = ktime_get_ns();
 
 	ret = clk_prepare_enable(imx678->xclk);
 	if (ret) {
@@ -1588,9 +3438,7 @@ static int imx678_power_on(struct device *dev)
 		goto reg_off;
 	}
 
-	gpiod_set_value_cansleep(imx678->reset_gpio, 1);
-	usleep_range(IMX678_XCLR_MIN_DELAY_US,
-			 IMX678_XCLR_MIN_DELAY_US + IMX678_XCLR_DELAY_RANGE_US);
+	imx678_xclr_release(imx678, supplied_ns);
 
 	return 0;
 
@@ -1599,13 +3447,37 @@ reg_off:
 	return ret;
 }
 
+/* Drop a retained sensor, it was left in standby with INCK already gated */
+static void imx678_release_retention(struct imx678 *imx678)
+{
+	if (!imx678->retained)
+		return;
+
+	imx678_xclr_assert(imx678);
+	regulator_bulk_disable(imx678_NUM_SUPPLIES, imx678->supplies);
+
+	imx678->retained = false;
+	imx678->common_regs_written = false;
+}
+
 static int imx678_power_off(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct imx678 *imx678 = to_imx678(sd);
 
-	gpiod_set_value_cansleep(imx678->reset_gpio, 0);
+	/*
+	 * With the supplies staying up the sensor is left in software standby,
+	 * so gating INCK keeps every register and the next power on skips XCLR
+	 * and the common register upload.
+	 */
+	if (imx678->standby_retention) {
+		clk_disable_unprepare(imx678->xclk);
+		imx678->retained = true;
+		return 0;
+	}
+
+	imx678_xclr_assert(imx678);
 	regulator_bulk_disable(imx678_NUM_SUPPLIES, imx678->supplies);
 	clk_disable_unprepare(imx678->xclk);
 
@@ -1615,14 +3487,39 @@ static int imx678_power_off(struct device *dev)
 	return 0;
 }
 
+/*
+ * System sleep powers the sensor down completely, retention included, so
+ * no register contents survive it. On resume the sensor is only powered if
+ * it was in use, and a stream that was running is started again the way
+ * stream on does it: the common register table (sent as bursts), the mode
+ * table, then the control handler replays every control value through
+ * s_ctrl. Suspend/resume run async so the XCLR wait overlaps with the
+ * other devices.
+ */
 static int __maybe_unused imx678_suspend(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct imx678 *imx678 = to_imx678(sd);
+	int ret;
 
+	/* Resume restarts the stream in its own mode, with no ramp running */
+	mutex_lock(&imx678->mutex);
+	imx678_stop_flush(imx678);
+	imx678_snapshot_end(imx678, false);
+	__v4l2_ctrl_s_ctrl(imx678->snapshot, 0);
+	imx678_ramp_stop(imx678);
+	__v4l2_ctrl_s_ctrl(imx678->ramp_frames, 0);
 	if (imx678->streaming)
 		imx678_stop_streaming(imx678);
+	mutex_unlock(&imx678->mutex);
+	imx678_cancel_deferred(imx678);
+
+	ret = pm_runtime_force_suspend(dev);
+	if (ret)
+		return ret;
+
+	imx678_release_retention(imx678);
 
 	return 0;
 }
@@ -1634,17 +3531,25 @@ static int __maybe_unused imx678_resume(struct device *dev)
 	struct imx678 *imx678 = to_imx678(sd);
 	int ret;
 
+	ret = pm_runtime_force_resume(dev);
+	if (ret)
+		return ret;
+
+	mutex_lock(&imx678->mutex);
 	if (imx678->streaming) {
 		ret = imx678_start_streaming(imx678);
 		if (ret)
 			goto error;
+		__imx678_history_record(imx678, imx678->frame_base_ns);
 	}
+	mutex_unlock(&imx678->mutex);
 
 	return 0;
 
 error:
 	imx678_stop_streaming(imx678);
 	imx678->streaming = 0;
+	mutex_unlock(&imx678->mutex);
 	return ret;
 }
 
@@ -1681,14 +3586,148 @@ static int imx678_check_module_exists(struct imx678 *imx678)
 	return 0;
 }
 
+/* Align a crop request and move it inside the pixel array */
+static void imx678_roi_adjust(struct imx678 *imx678, struct v4l2_rect *r)
+{
+	const struct v4l2_rect *pa = &imx678->chip->pixel_array;
+	s32 left, top;
+
+	r->width = clamp_t(u32, ALIGN_DOWN(r->width, IMX678_ROI_WIDTH_ALIGN),
+			   IMX678_ROI_MIN_WIDTH, pa->width);
+	r->height = clamp_t(u32, ALIGN_DOWN(r->height, IMX678_ROI_HEIGHT_ALIGN),
+			    IMX678_ROI_MIN_HEIGHT, pa->height);
+
+	left = clamp_t(s32, r->left - pa->left, 0, pa->width - r->width);
+	top = clamp_t(s32, r->top - pa->top, 0, pa->height - r->height);
+	r->left = pa->left + ALIGN_DOWN(left, IMX678_ROI_POS_ALIGN);
+	r->top = pa->top + ALIGN_DOWN(top, IMX678_ROI_POS_ALIGN);
+}
+
+/* Window registers of @r, start and size, in address order */
+static unsigned int imx678_roi_window_regs(struct imx678 *imx678, const struct v4l2_rect *r,
+					   struct imx678_reg *regs, bool size)
+{
+	const struct v4l2_rect *pa = &imx678->chip->pixel_array;
+	const struct {
+		u16 reg;
+		u16 val;
+		bool size;
+	} win[] = {
+		{ IMX678_REG_PIX_HST,    r->left - pa->left, false },
+		{ IMX678_REG_PIX_HWIDTH, r->width,           true },
+		{ IMX678_REG_PIX_VST,    r->top - pa->top,   false },
+		{ IMX678_REG_PIX_VWIDTH, r->height,          true },
+	};
+	unsigned int i, n = 0;
+
+	for (i = 0; i < ARRAY_SIZE(win); i++) {
+		if (win[i].size && !size)
+			continue;
+		regs[n++] = (struct imx678_reg){ win[i].reg, win[i].val & 0xff };
+		regs[n++] = (struct imx678_reg){ win[i].reg + 1, win[i].val >> 8 };
+	}
+
+	return n;
+}
+
+/*
+ * Make roi_mode the full resolution mode cropped to @r. The frame keeps
+ * the full mode's vertical blanking overhead on top of the window height,
+ * which is what lets a small window run at a high frame rate.
+ */
+static int imx678_roi_build(struct imx678 *imx678, const struct v4l2_rect *r)
+{
+	const struct imx678_mode *full = imx678_full_mode(imx678);
+	const struct IMX678_reg_list *full_regs = &full->reg_list;
+	struct imx678_mode *roi = &imx678->roi_mode;
+	struct imx678_reg *regs = imx678->roi_regs;
+	unsigned int i, n = 0;
+
+	if (WARN_ON(full_regs->num_of_regs + 9 > ARRAY_SIZE(imx678->roi_regs)))
+		return -EINVAL;
+
+	regs[n++] = (struct imx678_reg){ IMX678_REG_WINMODE, IMX678_WINMODE_CROP };
+	for (i = 0; i < full_regs->num_of_regs; i++)
+		if (full_regs->regs[i].address != IMX678_REG_WINMODE)
+			regs[n++] = full_regs->regs[i];
+	n += imx678_roi_window_regs(imx678, r, &regs[n], true);
+
+	*roi = *full;
+	roi->width = r->width;
+	roi->height = r->height;
+	roi->crop = *r;
+	roi->min_VMAX = ALIGN(r->height + full->min_VMAX - full->height, 2);
+	roi->default_VMAX = roi->min_VMAX;
+	roi->reg_list.regs = regs;
+	roi->reg_list.num_of_regs = n;
+
+	return 0;
+}
+
+/* Select the readout window while not streaming, the format follows it */
+static int imx678_roi_set(struct imx678 *imx678, const struct v4l2_rect *r)
+{
+	const struct imx678_mode *full = imx678_full_mode(imx678);
+	int ret;
+
+	if (v4l2_rect_equal(r, &full->crop)) {
+		imx678->mode = full;
+	} else {
+		ret = imx678_roi_build(imx678, r);
+		if (ret)
+			return ret;
+		imx678->mode = &imx678->roi_mode;
+	}
+
+	imx678_set_framing_limits(imx678);
+
+	return 0;
+}
+
+/*
+ * Move the window at a fixed size while streaming. The start registers
+ * are written under group hold, so the new position takes effect as a
+ * whole at the next frame start; the history records it against the
+ * frame being read out.
+ */
+static int imx678_roi_pan(struct imx678 *imx678, const struct v4l2_rect *r)
+{
+	struct imx678_reg regs[4];
+	unsigned int n;
+	int ret;
+
+	lockdep_assert_held(&imx678->mutex);
+
+	if (r->left == imx678->roi_mode.crop.left && r->top == imx678->roi_mode.crop.top)
+		return 0;
+
+	n = imx678_roi_window_regs(imx678, r, regs, false);
+
+	imx678_register_hold(imx678, true);
+	ret = imx678_write_regs(imx678, regs, n);
+	imx678_register_hold(imx678, false);
+	if (ret)
+		return ret;
+
+	/* Same size, so only the window registers of the list change */
+	imx678_roi_window_regs(imx678, r,
+			       &imx678->roi_regs[imx678->roi_mode.reg_list.num_of_regs - 8],
+			       true);
+	imx678->roi_mode.crop = *r;
+	imx678_apply_window(imx678, &imx678->roi_mode);
+	imx678_history_record(imx678);
+
+	return 0;
+}
+
 static int imx678_get_selection(struct v4l2_subdev *sd,
 				struct v4l2_subdev_state *sd_state,
 				struct v4l2_subdev_selection *sel)
 {
+	struct imx678 *imx678 = to_imx678(sd);
+
 	switch (sel->target) {
 	case V4L2_SEL_TGT_CROP: {
-		struct imx678 *imx678 = to_imx678(sd);
-
 		mutex_lock(&imx678->mutex);
 		sel->r = *__imx678_get_pad_crop(imx678, sd_state, sel->pad, sel->which);
 		mutex_unlock(&imx678->mutex);
@@ -1699,24 +3738,156 @@ static int imx678_get_selection(struct v4l2_subdev *sd,
 	case V4L2_SEL_TGT_NATIVE_SIZE:
 		sel->r.left = 0;
 		sel->r.top = 0;
-		sel->r.width = IMX678_NATIVE_WIDTH;
-		sel->r.height = IMX678_NATIVE_HEIGHT;
+		sel->r.width = imx678->chip->native_width;
+		sel->r.height = imx678->chip->native_height;
 		return 0;
 
 	case V4L2_SEL_TGT_CROP_DEFAULT:
 	case V4L2_SEL_TGT_CROP_BOUNDS:
-		sel->r.left = IMX678_PIXEL_ARRAY_LEFT;
-		sel->r.top = IMX678_PIXEL_ARRAY_TOP;
-		sel->r.width = IMX678_PIXEL_ARRAY_WIDTH;
-		sel->r.height = IMX678_PIXEL_ARRAY_HEIGHT;
+		sel->r = imx678->chip->pixel_array;
 		return 0;
 	}
 
 	return -EINVAL;
 }
 
+/*
+ * The crop selects a window of the full resolution readout and the format
+ * follows its size; a crop of the whole array goes back to the full mode.
+ * While streaming only a window of the current size can be moved.
+ */
+static int imx678_set_selection(struct v4l2_subdev *sd,
+				struct v4l2_subdev_state *sd_state,
+				struct v4l2_subdev_selection *sel)
+{
+	struct imx678 *imx678 = to_imx678(sd);
+	struct v4l2_rect r = sel->r;
+	int ret;
+
+	if (sel->target != V4L2_SEL_TGT_CROP || sel->pad != IMAGE_PAD)
+		return -EINVAL;
+
+	imx678_roi_adjust(imx678, &r);
+
+	if (sel->which == V4L2_SUBDEV_FORMAT_TRY) {
+		struct v4l2_mbus_framefmt *fmt = v4l2_subdev_state_get_format(sd_state, IMAGE_PAD);
+
+		*v4l2_subdev_state_get_crop(sd_state, IMAGE_PAD) = r;
+		fmt->width = r.width;
+		fmt->height = r.height;
+		sel->r = r;
+
+		return 0;
+	}
+
+	mutex_lock(&imx678->mutex);
+
+	if (!imx678->streaming)
+		ret = imx678_roi_set(imx678, &r);
+	else if (!imx678_roi_active(imx678) || imx678->snapshot_mode ||
+		 r.width != imx678->roi_mode.width || r.height != imx678->roi_mode.height)
+		ret = -EBUSY;
+	else
+		ret = imx678_roi_pan(imx678, &r);
+
+	if (!ret)
+		sel->r = r;
+
+	mutex_unlock(&imx678->mutex);
+
+	return ret;
+}
+
+static int imx678_get_mbus_config(struct v4l2_subdev *sd, unsigned int pad,
+				  struct v4l2_mbus_config *config)
+{
+	struct imx678 *imx678 = to_imx678(sd);
+
+	if (pad >= NUM_PADS)
+		return -EINVAL;
+
+	config->type = V4L2_MBUS_CSI2_DPHY;
+
+	mutex_lock(&imx678->mutex);
+	config->bus.mipi_csi2.num_data_lanes = imx678_cur_lanes(imx678);
+	config->bus.mipi_csi2.flags = imx678->ep_noncont_clk ?
+				      V4L2_MBUS_CSI2_NONCONTINUOUS_CLOCK : 0;
+	mutex_unlock(&imx678->mutex);
+
+	return 0;
+}
+
+/*
+ * Frames to drop after stream on. Stream on writes the mode and every
+ * control in standby, so they all latch for the first frame, but that
+ * frame's exposure started in the frame before it, which never ran, so
+ * the first frame is always dropped. With external sync the sensor runs
+ * on its own timing until the first XVS pulse, and that pulse also cuts
+ * short the frame it arrives in.
+ *
+ * Both counts are fixed, conservative values. The driver can't see when
+ * the first XVS pulse arrives, so one more frame is skipped with external
+ * sync whether or not the pulses were already running at stream on.
+ */
+static int imx678_g_skip_frames(struct v4l2_subdev *sd, u32 *frames)
+{
+	struct imx678 *imx678 = to_imx678(sd);
+
+	*frames = imx678_sync_mode(imx678) ? 2 : 1;
+
+	return 0;
+}
+
+/*
+ * No frame number capability is reported: the sensor has no documented
+ * setting for the frame number field of its FS/FE short packets, and the
+ * frame descriptor has no flag for one. Receivers see drops from frame
+ * timestamps against the frame interval, see imx678_frame_ns().
+ */
+static int imx678_get_frame_desc(struct v4l2_subdev *sd, unsigned int pad,
+				 struct v4l2_mbus_frame_desc *fd)
+{
+	struct imx678 *imx678 = to_imx678(sd);
+
+	if (pad >= NUM_PADS)
+		return -EINVAL;
+
+	mutex_lock(&imx678->mutex);
+
+	memset(fd, 0, sizeof(*fd));
+	fd->type = V4L2_MBUS_FRAME_DESC_TYPE_CSI2;
+
+	fd->entry[0].pixelcode = imx678_get_format_code(imx678, imx678->fmt_code);
+	fd->entry[0].stream = IMAGE_PAD;
+	fd->entry[0].bus.csi2.vc = IMX678_VC;
+	fd->entry[0].bus.csi2.dt = MIPI_CSI2_DT_RAW12;
+
+	fd->entry[1].pixelcode = MEDIA_BUS_FMT_SENSOR_DATA;
+	fd->entry[1].stream = METADATA_PAD;
+	fd->entry[1].flags = V4L2_MBUS_FRAME_DESC_FL_LEN_MAX;
+	fd->entry[1].length = IMX678_EMBEDDED_LINE_WIDTH * IMX678_NUM_EMBEDDED_LINES;
+	fd->entry[1].bus.csi2.vc = IMX678_VC;
+	fd->entry[1].bus.csi2.dt = MIPI_CSI2_DT_EMBEDDED_8B;
+
+	fd->num_entries = 2;
+	mutex_unlock(&imx678->mutex);
+
+	return 0;
+}
+
+static int imx678_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				  struct v4l2_event_subscription *sub)
+{
+	switch (sub->type) {
+	case V4L2_EVENT_SOURCE_CHANGE:
+		return v4l2_src_change_event_subdev_subscribe(sd, fh, sub);
+	default:
+		return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+	}
+}
+
 static const struct v4l2_subdev_core_ops imx678_core_ops = {
-	.subscribe_event = v4l2_ctrl_subdev_subscribe_event,
+	.subscribe_event = imx678_subscribe_event,
 	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
@@ -1729,13 +3900,21 @@ static const struct v4l2_subdev_pad_ops imx678_pad_ops = {
 	.get_fmt = imx678_get_pad_format,
 	.set_fmt = imx678_set_pad_format,
 	.get_selection = imx678_get_selection,
+	.set_selection = imx678_set_selection,
 	.enum_frame_size = imx678_enum_frame_size,
+	.get_mbus_config = imx678_get_mbus_config,
+	.get_frame_desc = imx678_get_frame_desc,
+};
+
+static const struct v4l2_subdev_sensor_ops imx678_sensor_ops = {
+	.g_skip_frames = imx678_g_skip_frames,
 };
 
 static const struct v4l2_subdev_ops imx678_subdev_ops = {
 	.core = &imx678_core_ops,
 	.video = &imx678_video_ops,
 	.pad = &imx678_pad_ops,
+	.sensor = &imx678_sensor_ops,
 };
 
 static const struct v4l2_subdev_internal_ops imx678_internal_ops = {
@@ -1748,6 +3927,7 @@ static int imx678_init_controls(struct imx678 *imx678)
 	struct v4l2_ctrl_handler *ctrl_hdlr;
 	struct i2c_client *client = v4l2_get_subdevdata(&imx678->sd);
 	struct v4l2_fwnode_device_properties props;
+	struct v4l2_ctrl_config cfg;
 	int ret;
 
 	ctrl_hdlr = &imx678->ctrl_handler;
@@ -1769,13 +3949,16 @@ static int imx678_init_controls(struct imx678 *imx678)
 					       0xffff, 1,
 					       0xffff);
 
-	/* LINK_FREQ is also read only */
+	/* LINK_FREQ is also read only, only DT listed entries can be selected */
 	imx678->link_freq =
 		v4l2_ctrl_new_int_menu(ctrl_hdlr, &imx678_ctrl_ops,
-				       V4L2_CID_LINK_FREQ, 0, 0,
-				       &link_freqs[imx678->link_freq_idx]);
-	if (imx678->link_freq)
+				       V4L2_CID_LINK_FREQ,
+				       ARRAY_SIZE(link_freqs) - 1,
+				       imx678->link_freq_idx, link_freqs);
+	if (imx678->link_freq) {
 		imx678->link_freq->flags |= V4L2_CTRL_FLAG_READ_ONLY;
+		imx678->link_freq->menu_skip_mask = ~imx678->link_freq_mask;
+	}
 
 	imx678->vblank = v4l2_ctrl_new_std(ctrl_hdlr, &imx678_ctrl_ops,
 					   V4L2_CID_VBLANK, 0, 0xfffff, 1, 0);
@@ -1793,13 +3976,35 @@ static int imx678_init_controls(struct imx678 *imx678)
 					     IMX678_EXPOSURE_DEFAULT);
 
 	imx678->gain = v4l2_ctrl_new_std(ctrl_hdlr, &imx678_ctrl_ops, V4L2_CID_ANALOGUE_GAIN,
-					 IMX678_ANA_GAIN_MIN_NORMAL, IMX678_ANA_GAIN_MAX_NORMAL,
+					 IMX678_ANA_GAIN_MIN_NORMAL, imx678->chip->gain_max,
 					 IMX678_ANA_GAIN_STEP, IMX678_ANA_GAIN_DEFAULT);
 
 	imx678->hflip = v4l2_ctrl_new_std(ctrl_hdlr, &imx678_ctrl_ops, V4L2_CID_HFLIP, 0, 1, 1, 0);
 	imx678->vflip = v4l2_ctrl_new_std(ctrl_hdlr, &imx678_ctrl_ops, V4L2_CID_VFLIP, 0, 1, 1, 0);
 
-	imx678->hcg_ctrl = v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_hcg, NULL);
+	if (imx678->chip->has_hcg)
+		imx678->hcg_ctrl = v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_hcg, NULL);
+
+	imx678->snapshot = v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_snapshot, NULL);
+
+	imx678->ramp_exposure = v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_ramp_exposure, NULL);
+	cfg = imx678_cfg_ramp_gain;
+	cfg.max = imx678->chip->gain_max;
+	imx678->ramp_gain = v4l2_ctrl_new_custom(ctrl_hdlr, &cfg, NULL);
+	imx678->ramp_frames = v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_ramp_frames, NULL);
+	v4l2_ctrl_cluster(3, &imx678->ramp_frames);
+
+	imx678->stop_mode = v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_stop_mode, NULL);
+
+	imx678->preset_slot = v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_preset_slot, NULL);
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_preset_save, NULL);
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_preset_apply, NULL);
+
+#ifndef IMX678_FIXED_LINK
+	imx678->link_qualify = v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_link_qualify, NULL);
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_link_test_pass, NULL);
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx678_cfg_link_test_fail, NULL);
+#endif
 
 	if (ctrl_hdlr->error) {
 		ret = ctrl_hdlr->error;
@@ -1819,7 +4024,9 @@ static int imx678_init_controls(struct imx678 *imx678)
 	imx678->sd.ctrl_handler = ctrl_hdlr;
 
 	/* Setup exposure and frame/line length limits. */
+	mutex_lock(&imx678->mutex);
 	imx678_set_framing_limits(imx678);
+	mutex_unlock(&imx678->mutex);
 
 	return 0;
 
@@ -1837,7 +4044,7 @@ static void imx678_free_controls(struct imx678 *imx678)
 }
 
 static const struct of_device_id imx678_dt_ids[] = {
-	{ .compatible = "sony,imx678"},
+	{ .compatible = "sony,imx678", .data = &imx678_chip },
 	{ /* sentinel */ }
 };
 
@@ -1861,14 +4068,38 @@ static int imx678_check_hwcfg(struct device *dev, struct imx678 *imx678)
 		goto error_out;
 	}
 
+#ifdef IMX678_FIXED_LANES
+	if (ep_cfg.bus.mipi_csi2.num_data_lanes != IMX678_FIXED_LANES)
+		dev_warn(dev, "DT has %u data lanes, built for %u\n",
+			 ep_cfg.bus.mipi_csi2.num_data_lanes, IMX678_FIXED_LANES);
+	imx678->lane_count = IMX678_FIXED_LANES;
+#else
 	/* Check the number of MIPI CSI2 data lanes */
 	if (ep_cfg.bus.mipi_csi2.num_data_lanes != 2 && ep_cfg.bus.mipi_csi2.num_data_lanes != 4) {
 		dev_err(dev, "only 2 or 4 data lanes are currently supported\n");
 		goto error_out;
 	}
 	imx678->lane_count = ep_cfg.bus.mipi_csi2.num_data_lanes;
+#endif
 	dev_info(dev, "Data lanes: %d\n", imx678->lane_count);
 
+	/*
+	 * The clock lane mode is not programmed, it stays at what the common
+	 * register table leaves. The endpoint has to describe that mode, it
+	 * is only passed on to the receiver.
+	 */
+	imx678->ep_noncont_clk = ep_cfg.bus.mipi_csi2.flags &
+				 V4L2_MBUS_CSI2_NONCONTINUOUS_CLOCK;
+	dev_info(dev, "Clock lane: %s\n",
+		 imx678->ep_noncont_clk ? "non-continuous" : "continuous");
+
+#ifdef IMX678_FIXED_LINK_FREQ
+	if (!ep_cfg.nr_of_link_frequencies ||
+	    ep_cfg.link_frequencies[0] != IMX678_FIXED_LINK_FREQ)
+		dev_warn(dev, "DT link-frequencies do not start with %llu, built for it\n",
+			 (u64)IMX678_FIXED_LINK_FREQ);
+	imx678->link_freq_idx = IMX678_FIXED_LINK_IDX;
+#else
 	/* Check the link frequency set in device tree */
 	if (!ep_cfg.nr_of_link_frequencies) {
 		dev_err(dev, "link-frequency property not found in DT\n");
@@ -1888,8 +4119,69 @@ static int imx678_check_hwcfg(struct device *dev, struct imx678 *imx678)
 			ret = -EINVAL;
 			goto error_out;
 	}
+#endif
+
+	dev_info(dev, "Link Speed: %lld Mhz\n", link_freqs[imx678->link_freq_idx]);
+
+	imx678->link_freq_mask = BIT(imx678->link_freq_idx);
+	imx678->dphy_link = imx678->link_freq_idx;
+	imx678->cur_lane_count = imx678->lane_count;
+
+#ifdef IMX678_FIXED_LINK
+	if (device_property_read_bool(dev, "sony,link-downshift"))
+		dev_warn(dev, "sony,link-downshift ignored, built for a fixed link\n");
+#else
+	/*
+	 * The first link-frequencies entry is the one to run at, any further
+	 * entries are rates the receiver also accepts for link downshift.
+	 */
+	for (int j = 1; j < ep_cfg.nr_of_link_frequencies; j++) {
+		for (i = 0; i < ARRAY_SIZE(link_freqs); i++)
+			if (link_freqs[i] == ep_cfg.link_frequencies[j])
+				imx678->link_freq_mask |= BIT(i);
+	}
+
+	imx678->link_downshift = device_property_read_bool(dev, "sony,link-downshift");
+	if (imx678->link_downshift)
+		dev_info(dev, "Link downshift enabled\n");
+
+	/* Rates above the one link qualification found to work are left out */
+	if (max_link_freq && link_freqs[imx678->link_freq_idx] > max_link_freq) {
+		for (i = imx678->link_freq_idx; i > 0; i--)
+			if ((imx678->link_freq_mask & BIT(i - 1)) &&
+			    link_freqs[i - 1] <= max_link_freq)
+				break;
+
+		if (i) {
+			imx678->link_freq_idx = i - 1;
+			dev_info(dev, "Link capped to %lld Hz by max_link_freq\n",
+				 link_freqs[imx678->link_freq_idx]);
+		} else {
+			dev_warn(dev, "No link-frequencies entry within max_link_freq %lu\n",
+				 max_link_freq);
+		}
+	}
+#endif
+	imx678->cur_link_freq_idx = imx678->link_freq_idx;
+
+	/* Board specific D-PHY timing, e.g. for long traces at the top rates */
+	if (device_property_present(dev, "sony,dphy-timings")) {
+		u32 t[IMX678_DPHY_TIMING_NUM];
+		u16 *dst = (u16 *)&imx678->dphy;
+
+		ret = device_property_read_u32_array(dev, "sony,dphy-timings",
+						     t, ARRAY_SIZE(t));
+		if (ret) {
+			dev_err(dev, "sony,dphy-timings needs %zu cells (%pe)\n",
+				ARRAY_SIZE(t), ERR_PTR(ret));
+			goto error_out;
+		}
 
-	dev_info(dev, "Link Speed: %lld Mhz\n", ep_cfg.link_frequencies[0]);
+		for (i = 0; i < ARRAY_SIZE(t); i++)
+			dst[i] = t[i];
+		imx678->dphy_override = true;
+		dev_info(dev, "D-PHY timing overridden from DT\n");
+	}
 
 	ret = 0;
 
@@ -1900,12 +4192,97 @@ error_out:
 	return ret;
 }
 
+static int imx678_history_show(struct seq_file *s, void *unused)
+{
+	struct imx678 *imx678 = s->private;
+	struct imx678_history_entry *e;
+	unsigned int i, n;
+
+	e = kvmalloc_array(IMX678_HISTORY_LEN, sizeof(*e), GFP_KERNEL);
+	if (!e)
+		return -ENOMEM;
+
+	n = imx678_history_snapshot(&imx678->history, e);
+
+	seq_puts(s, "# index frame timestamp_ns shr vmax hmax gain hcg hflip vflip roi_left roi_top\n");
+	for (i = 0; i < n; i++)
+		seq_printf(s, "%u %u %llu %u %u %u %u %u %u %u %u %u\n",
+			   e[i].index, e[i].frame_seq, e[i].timestamp_ns,
+			   e[i].shr, e[i].vmax, e[i].hmax, e[i].gain, e[i].hcg,
+			   !!(e[i].flips & IMX678_HISTORY_HFLIP),
+			   !!(e[i].flips & IMX678_HISTORY_VFLIP),
+			   e[i].roi_left, e[i].roi_top);
+
+	kvfree(e);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(imx678_history);
+
+struct imx678_history_buf {
+	size_t len;
+	struct imx678_history_entry e[IMX678_HISTORY_LEN];
+};
+
+/* The binary file is a snapshot taken at open, so records never tear */
+static int imx678_history_bin_open(struct inode *inode, struct file *file)
+{
+	struct imx678 *imx678 = inode->i_private;
+	struct imx678_history_buf *buf;
+
+	buf = kvmalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	buf->len = imx678_history_snapshot(&imx678->history, buf->e) * sizeof(buf->e[0]);
+	file->private_data = buf;
+
+	return 0;
+}
+
+static ssize_t imx678_history_bin_read(struct file *file, char __user *ubuf,
+				       size_t count, loff_t *ppos)
+{
+	struct imx678_history_buf *buf = file->private_data;
+
+	return simple_read_from_buffer(ubuf, count, ppos, buf->e, buf->len);
+}
+
+static int imx678_history_bin_release(struct inode *inode, struct file *file)
+{
+	kvfree(file->private_data);
+
+	return 0;
+}
+
+static const struct file_operations imx678_history_bin_fops = {
+	.owner = THIS_MODULE,
+	.open = imx678_history_bin_open,
+	.read = imx678_history_bin_read,
+	.llseek = default_llseek,
+	.release = imx678_history_bin_release,
+};
+
+static void imx678_debugfs_init(struct imx678 *imx678, struct device *dev)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "imx678-%s", dev_name(dev));
+	imx678->debugfs = debugfs_create_dir(name, NULL);
+	debugfs_create_file("history", 0444, imx678->debugfs, imx678,
+			    &imx678_history_fops);
+	debugfs_create_file("history.bin", 0444, imx678->debugfs, imx678,
+			    &imx678_history_bin_fops);
+}
+
 static int imx678_probe(struct i2c_client *client)
 {
 	struct device *dev = &client->dev;
 	struct imx678 *imx678;
-	const struct of_device_id *match;
-	int ret, i;
+	int ret;
+#ifndef IMX678_FIXED_XCLK
+	int i;
+#endif
 	u32 sync_mode;
 
 	imx678 = devm_kzalloc(&client->dev, sizeof(*imx678), GFP_KERNEL);
@@ -1914,14 +4291,26 @@ static int imx678_probe(struct i2c_client *client)
 
 	v4l2_i2c_subdev_init(&imx678->sd, client, &imx678_subdev_ops);
 
-	match = of_match_device(imx678_dt_ids, dev);
-	if (!match)
+	imx678->chip = i2c_get_match_data(client);
+	if (!imx678->chip)
 		return -ENODEV;
+	if (WARN_ON(imx678->chip->num_modes > IMX678_MAX_MODES))
+		return -EINVAL;
+	memcpy(imx678->modes, imx678->chip->modes,
+	       imx678->chip->num_modes * sizeof(imx678->modes[0]));
+	dev_info(dev, "Sensor: %s\n", imx678->chip->name);
 
 	dev_info(dev, "Reading dtoverlay config:\n");
 
+#ifdef IMX678_FIXED_SYNC_MODE
+	imx678->sync_mode = IMX678_FIXED_SYNC_MODE;
+	if (!device_property_read_u32(dev, "sync-mode", &sync_mode) &&
+	    sync_mode != IMX678_FIXED_SYNC_MODE)
+		dev_warn(dev, "DT sync-mode %u ignored, built for %u\n",
+			 sync_mode, IMX678_FIXED_SYNC_MODE);
+#else
 	imx678->sync_mode = 0;
-	ret = of_property_read_u32(dev->of_node, "sync-mode", &sync_mode);
+	ret = device_property_read_u32(dev, "sync-mode", &sync_mode);
 	if (!ret) {
 		if (sync_mode > 2) {
 			dev_warn(dev, "sync-mode out of range, using 0\n");
@@ -1933,8 +4322,19 @@ static int imx678_probe(struct i2c_client *client)
 				ERR_PTR(ret));
 		return ret;
 	}
+#endif
 	dev_info(dev, "Sync Mode: %s\n", sync_mode_menu[imx678->sync_mode]);
 
+	/* Only safe when VANA stays on, e.g. the overlay's always-on option */
+	imx678->standby_retention = device_property_read_bool(dev,
+							      "sony,standby-retention");
+	if (imx678->standby_retention)
+		dev_info(dev, "Register retention in runtime suspend\n");
+
+	imx678->mid_stream_resize = device_property_read_bool(dev, "sony,mid-stream-resize");
+	if (imx678->mid_stream_resize)
+		dev_info(dev, "Frame size changes while streaming\n");
+
 	/* Check the hardware configuration in device tree */
 	if (imx678_check_hwcfg(dev, imx678))
 		return -EINVAL;
@@ -1948,6 +4348,14 @@ static int imx678_probe(struct i2c_client *client)
 
 	imx678->xclk_freq = clk_get_rate(imx678->xclk);
 
+#ifdef IMX678_FIXED_XCLK
+	if (imx678->xclk_freq != IMX678_FIXED_XCLK) {
+		dev_err(dev, "XCLK %u Hz, built for %u Hz\n",
+			imx678->xclk_freq, IMX678_FIXED_XCLK);
+		return -EINVAL;
+	}
+	imx678->inck_sel_val = IMX678_FIXED_INCK_SEL;
+#else
 	for (i = 0; i < ARRAY_SIZE(imx678_inck_table); ++i) {
 		if (imx678_inck_table[i].xclk_hz == imx678->xclk_freq) {
 			imx678->inck_sel_val = imx678_inck_table[i].inck_sel;
@@ -1960,6 +4368,7 @@ static int imx678_probe(struct i2c_client *client)
 			imx678->xclk_freq);
 		return -EINVAL;
 	}
+#endif
 
 	dev_info(dev, "XCLK %u Hz → INCK_SEL 0x%02x\n",
 		 imx678->xclk_freq, imx678->inck_sel_val);
@@ -1970,9 +4379,15 @@ static int imx678_probe(struct i2c_client *client)
 		return ret;
 	}
 
-	/* Request optional enable pin */
-	imx678->reset_gpio = devm_gpiod_get_optional(dev, "reset",
-							 GPIOD_OUT_HIGH);
+	/*
+	 * Request optional enable pin, held in reset until power on. It may
+	 * be wired to several sensors, which then power up together.
+	 */
+	imx678->xclr = imx678_xclr_get(dev);
+	if (IS_ERR(imx678->xclr)) {
+		dev_err(dev, "failed to get reset gpio\n");
+		return PTR_ERR(imx678->xclr);
+	}
 
 	/*
 	 * The sensor must be powered for imx678_check_module_exists()
@@ -1980,7 +4395,7 @@ static int imx678_probe(struct i2c_client *client)
 	 */
 	ret = imx678_power_on(dev);
 	if (ret)
-		return ret;
+		goto error_xclr_put;
 
 	ret = imx678_check_module_exists(imx678);
 	if (ret)
@@ -1990,10 +4405,21 @@ static int imx678_probe(struct i2c_client *client)
 	imx678_set_default_format(imx678);
 
 	/* Enable runtime PM and turn off the device */
+	device_enable_async_suspend(dev);
 	pm_runtime_set_active(dev);
 	pm_runtime_enable(dev);
 	pm_runtime_idle(dev);
 
+	hrtimer_init(&imx678->snapshot_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	imx678->snapshot_timer.function = imx678_snapshot_timer_fn;
+	INIT_WORK(&imx678->snapshot_work, imx678_snapshot_work);
+	hrtimer_init(&imx678->ramp_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	imx678->ramp_timer.function = imx678_ramp_timer_fn;
+	INIT_WORK(&imx678->ramp_work, imx678_ramp_work);
+	hrtimer_init(&imx678->stop_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	imx678->stop_timer.function = imx678_stop_timer_fn;
+	INIT_WORK(&imx678->stop_work, imx678_stop_work);
+
 	/* This needs the pm runtime to be registered. */
 	ret = imx678_init_controls(imx678);
 	if (ret)
@@ -2015,6 +4441,8 @@ static int imx678_probe(struct i2c_client *client)
 		goto error_handler_free;
 	}
 
+	imx678_debugfs_init(imx678, dev);
+
 	ret = v4l2_async_register_subdev_sensor(&imx678->sd);
 	if (ret < 0) {
 		dev_err(dev, "failed to register sensor sub-device: %d\n", ret);
@@ -2024,6 +4452,7 @@ static int imx678_probe(struct i2c_client *client)
 	return 0;
 
 error_media_entity:
+	debugfs_remove_recursive(imx678->debugfs);
 	media_entity_cleanup(&imx678->sd.entity);
 
 error_handler_free:
@@ -2031,11 +4460,20 @@ error_handler_free:
 
 error_pm_runtime:
 	pm_runtime_disable(&client->dev);
+	/* pm_runtime_idle() may have powered it off already */
+	if (pm_runtime_status_suspended(&client->dev))
+		goto error_release_retention;
 	pm_runtime_set_suspended(&client->dev);
 
 error_power_off:
 	imx678_power_off(&client->dev);
 
+error_release_retention:
+	imx678_release_retention(imx678);
+
+error_xclr_put:
+	imx678_xclr_put(imx678->xclr);
+
 	return ret;
 }
 
@@ -2045,17 +4483,33 @@ static void imx678_remove(struct i2c_client *client)
 	struct imx678 *imx678 = to_imx678(sd);
 
 	v4l2_async_unregister_subdev(sd);
+	mutex_lock(&imx678->mutex);
+	imx678->snapshot_mode = NULL;
+	imx678_ramp_stop(imx678);
+	imx678_stop_flush(imx678);
+	mutex_unlock(&imx678->mutex);
+	imx678_cancel_deferred(imx678);
+	debugfs_remove_recursive(imx678->debugfs);
 	media_entity_cleanup(&sd->entity);
 	imx678_free_controls(imx678);
 
 	pm_runtime_disable(&client->dev);
 	if (!pm_runtime_status_suspended(&client->dev))
 		imx678_power_off(&client->dev);
+	imx678_release_retention(imx678);
 	pm_runtime_set_suspended(&client->dev);
+	imx678_xclr_put(imx678->xclr);
 }
 
 MODULE_DEVICE_TABLE(of, imx678_dt_ids);
 
+/* For instances created without DT, e.g. by the imx678-sim module */
+static const struct i2c_device_id imx678_ids[] = {
+	{ "imx678", (kernel_ulong_t)&imx678_chip },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(i2c, imx678_ids);
+
 static const struct dev_pm_ops imx678_pm_ops = {
 	SET_SYSTEM_SLEEP_PM_OPS(imx678_suspend, imx678_resume)
 	SET_RUNTIME_PM_OPS(imx678_power_off, imx678_power_on, NULL)
@@ -2066,7 +4520,10 @@ static struct i2c_driver imx678_i2c_driver = {
 		.name = "imx678",
 		.of_match_table = imx678_dt_ids,
 		.pm = &imx678_pm_ops,
+		/* Sensors on one XCLR line power up in parallel */
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
+	.id_table = imx678_ids,
 	.probe = imx678_probe,
 	.remove = imx678_remove,
 };